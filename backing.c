@@ -0,0 +1,657 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "globals.h"
+#include "region_list.h"
+#include "block_table.h"
+#include "pool.h"
+#include "frame.h"
+#include "large.h"
+#include "gap_index.h"
+#include "numa.h"
+#include "prefault.h"
+
+#define FILE_MAGIC "RREGION"
+#define SHARED_MAGIC 0x52524547
+#define INITIAL_TABLE_CAPACITY 16
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 1U
+#endif
+
+typedef struct FILE_HEADER file_header;
+typedef struct SHARED_HEADER shared_header;
+
+/* Region file layout: header, block table, then the region data. */
+
+struct FILE_HEADER
+{
+	char magic[8];
+	rsize_t size;
+	rsize_t capacity;
+	unsigned int data_offset;
+};
+
+/* Shared segment layout: header, block table, then the region data. The
+ * magic is stored last by the creator, so an attacher never sees a half
+ * initialised segment. */
+
+struct SHARED_HEADER
+{
+	unsigned int magic;
+	pthread_mutex_t lock;
+	rsize_t size;
+	rsize_t capacity;
+	rsize_t bytes_used;
+	unsigned int data_offset;
+};
+
+unsigned int round_to_alignment(unsigned int input);
+boolean shared_name(const char * region_name, char * name);
+boolean init_shared_lock(pthread_mutex_t * lock);
+
+boolean heap_backing(region_node * region, rsize_t region_size)
+{
+	assert(NULL != region);
+	assert(0 < region_size);
+
+	boolean success = false;
+
+	if (NULL != region && 0 < region_size)
+	{
+		region->data = malloc(region_size);
+		assert(NULL != region->data);
+
+		region->size = region_size;
+		region->block_table = NULL;
+		region->backing = HEAP_BACKING;
+		region->mapping = NULL;
+		region->mapping_size = 0;
+
+		success = NULL != region->data;
+	}
+
+	return success;
+}
+
+/* Like heap backing, but the data is its own mapping so a memory policy
+ * can be set on it before the first page is touched. If the policy cannot
+ * be set the region keeps the default one. The mapping is anonymous, or
+ * shares the memfd when fd is not -1. */
+
+static boolean mapped_backing(region_node * region, rsize_t region_size, int fd,
+		numa_policy policy, int node)
+{
+	assert(NULL != region);
+	assert(0 < region_size);
+
+	boolean success = false;
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t mapping_size = (region_size + page_size - 1) / page_size * page_size;
+	void * mapping = MAP_FAILED;
+	void * table = NULL;
+
+	if (NULL != region && 0 < region_size)
+	{
+		mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE,
+				-1 == fd ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED, fd, 0);
+	}
+
+	if (MAP_FAILED != mapping)
+	{
+		table = alloc_block_table(INITIAL_TABLE_CAPACITY);
+		assert(NULL != table);
+	}
+
+	if (NULL != table)
+	{
+		if (!apply_numa_policy(mapping, mapping_size, policy, &node))
+		{
+			policy = NUMA_DEFAULT;
+			node = -1;
+		}
+
+		region->block_table = table;
+		region->size = region_size;
+		region->data = mapping;
+		region->backing = -1 == fd ? NUMA_BACKING : MEMFD_BACKING;
+		region->fd = fd;
+		region->numa = policy;
+		region->numa_node = node;
+		region->mapping = mapping;
+		region->mapping_size = mapping_size;
+
+		success = true;
+	}
+	else if (MAP_FAILED != mapping)
+	{
+		munmap(mapping, mapping_size);
+	}
+
+	return success;
+}
+
+boolean numa_backing(region_node * region, rsize_t region_size, numa_policy policy, int node)
+{
+	return mapped_backing(region, region_size, -1, policy, node);
+}
+
+/* The data lives in an anonymous memory file, which clone_backing can map
+ * again copy-on-write. The region owns the descriptor. */
+
+boolean memfd_backing(region_node * region, rsize_t region_size, numa_policy policy, int node)
+{
+	assert(NULL != region);
+	assert(0 < region_size);
+
+	boolean success = false;
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t mapping_size = (region_size + page_size - 1) / page_size * page_size;
+	int fd = -1;
+
+	if (NULL != region && 0 < region_size)
+	{
+		fd = syscall(SYS_memfd_create, "region", MFD_CLOEXEC);
+	}
+
+	if (-1 != fd && 0 == ftruncate(fd, mapping_size))
+	{
+		success = mapped_backing(region, region_size, fd, policy, node);
+	}
+
+	if (!success && -1 != fd)
+	{
+		close(fd);
+	}
+
+	return success;
+}
+
+/* Gives the clone the source's data and a heap copy of its table, so every
+ * block keeps its offset. A memfd source is mapped privately, so the clone
+ * copies a page only when it writes it, and pages it has not written still
+ * show the source's later writes. Any other source is copied outright. The
+ * source must be locked by the caller. */
+
+boolean clone_backing(region_node * clone, region_node * source)
+{
+	assert(NULL != clone);
+	assert(NULL != source);
+
+	boolean success = false;
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t mapping_size = 0;
+	void * mapping = MAP_FAILED;
+	void * table = NULL;
+
+	if (NULL != clone && NULL != source && NULL != source->block_table)
+	{
+		mapping_size = (source->size + page_size - 1) / page_size * page_size;
+
+		if (MEMFD_BACKING == source->backing)
+		{
+			mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, source->fd, 0);
+		}
+		else
+		{
+			mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+			if (MAP_FAILED != mapping)
+			{
+				memcpy(mapping, source->data, source->size);
+			}
+		}
+	}
+
+	if (MAP_FAILED != mapping)
+	{
+		table = copy_block_table(source->block_table);
+		assert(NULL != table);
+	}
+
+	if (NULL != table)
+	{
+		clone->block_table = table;
+		clone->size = source->size;
+		clone->data = mapping;
+		clone->backing = CLONE_BACKING;
+		clone->mapping = mapping;
+		clone->mapping_size = mapping_size;
+
+		/* A private mapping of the memfd keeps the source's policy */
+
+		if (MEMFD_BACKING == source->backing)
+		{
+			clone->numa = source->numa;
+			clone->numa_node = source->numa_node;
+		}
+
+		success = true;
+	}
+	else if (MAP_FAILED != mapping)
+	{
+		munmap(mapping, mapping_size);
+	}
+
+	return success;
+}
+
+boolean file_backing(region_node * region, const char * path, rsize_t region_size)
+{
+	assert(NULL != region);
+	assert(NULL != path);
+	assert(0 < region_size);
+
+	boolean success = false;
+	file_header header;
+	struct stat file_stat;
+	unsigned int table_start = round_to_alignment(sizeof(file_header));
+	size_t mapping_size;
+	void * mapping = MAP_FAILED;
+	boolean existed;
+	int fd = -1;
+
+	if (NULL != region && NULL != path && 0 < region_size)
+	{
+		fd = open(path, O_RDWR | O_CREAT, 0644);
+		success = 0 <= fd && 0 == fstat(fd, &file_stat);
+	}
+
+	if (success)
+	{
+		existed = 0 < file_stat.st_size;
+
+		if (existed)
+		{
+			success = sizeof(file_header) == pread(fd, &header, sizeof(file_header), 0)
+				&& 0 == memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC))
+				&& 0 < header.size
+				&& header.capacity == header.size / BLOCK_ALIGNMENT
+				&& header.data_offset >= table_start + table_bytes(header.capacity)
+				&& (off_t)header.data_offset + header.size == file_stat.st_size;
+		}
+		else
+		{
+			memset(&header, 0, sizeof(file_header));
+			memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+			header.size = region_size;
+			header.capacity = region_size / BLOCK_ALIGNMENT;
+			header.data_offset = round_to_alignment(table_start + table_bytes(header.capacity));
+
+			success = 0 == ftruncate(fd, (off_t)header.data_offset + header.size);
+		}
+	}
+
+	if (success)
+	{
+		mapping_size = (size_t)header.data_offset + header.size;
+		mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		success = MAP_FAILED != mapping;
+	}
+
+	if (success)
+	{
+		if (existed)
+		{
+			region->block_table = load_block_table((char *)mapping + table_start,
+					header.capacity, header.size);
+		}
+		else
+		{
+			memcpy(mapping, &header, sizeof(file_header));
+			region->block_table = new_block_table((char *)mapping + table_start,
+					header.capacity);
+		}
+
+		success = NULL != region->block_table;
+
+		if (success)
+		{
+			region->size = header.size;
+			region->data = (char *)mapping + header.data_offset;
+			region->backing = FILE_BACKING;
+			region->mapping = mapping;
+			region->mapping_size = mapping_size;
+		}
+		else
+		{
+			munmap(mapping, mapping_size);
+		}
+	}
+
+	if (0 <= fd)
+	{
+		close(fd);
+	}
+
+	return success;
+}
+
+/* A child's data is a block of its parent's data. Only the child's block
+ * table is allocated on the heap, and it grows like a heap region's. */
+
+boolean child_backing(region_node * region, void * data_start, rsize_t region_size)
+{
+	assert(NULL != region);
+	assert(NULL != data_start);
+	assert(0 < region_size);
+
+	boolean success = false;
+	void * table;
+
+	if (NULL != region && NULL != data_start && 0 < region_size)
+	{
+		table = alloc_block_table(INITIAL_TABLE_CAPACITY);
+		assert(NULL != table);
+
+		if (NULL != table)
+		{
+			region->block_table = table;
+			region->size = region_size;
+			region->data = data_start;
+			region->backing = CHILD_BACKING;
+			region->mapping = NULL;
+			region->mapping_size = 0;
+
+			success = true;
+		}
+	}
+
+	return success;
+}
+
+boolean shared_backing(region_node * region, rsize_t region_size, boolean create)
+{
+	assert(NULL != region);
+	assert(NULL != region->name);
+	assert(!create || 0 < region_size);
+
+	char name[NAME_MAX];
+	boolean success;
+	shared_header * header = NULL;
+	struct stat segment_stat;
+	unsigned int table_start = round_to_alignment(sizeof(shared_header));
+	unsigned int data_offset = 0;
+	size_t mapping_size = 0;
+	void * mapping = MAP_FAILED;
+	int fd = -1;
+
+	success = NULL != region && shared_name(region->name, name)
+		&& (!create || 0 < region_size);
+
+	if (success && create)
+	{
+		data_offset = round_to_alignment(table_start
+				+ table_bytes(region_size / BLOCK_ALIGNMENT));
+		mapping_size = (size_t)data_offset + region_size;
+
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+		success = 0 <= fd && 0 == ftruncate(fd, mapping_size);
+	}
+	else if (success)
+	{
+		fd = shm_open(name, O_RDWR, 0);
+		success = 0 <= fd && 0 == fstat(fd, &segment_stat)
+			&& sizeof(shared_header) <= (size_t)segment_stat.st_size;
+		mapping_size = segment_stat.st_size;
+	}
+
+	if (success)
+	{
+		mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		success = MAP_FAILED != mapping;
+		header = mapping;
+	}
+
+	if (success && create)
+	{
+		header->size = region_size;
+		header->capacity = region_size / BLOCK_ALIGNMENT;
+		header->bytes_used = 0;
+		header->data_offset = data_offset;
+
+		success = init_shared_lock(&header->lock)
+			&& NULL != new_block_table((char *)mapping + table_start, header->capacity);
+
+		__atomic_store_n(&header->magic, SHARED_MAGIC, __ATOMIC_RELEASE);
+	}
+	else if (success)
+	{
+		success = SHARED_MAGIC == __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE)
+			&& (size_t)header->data_offset + header->size == mapping_size;
+	}
+
+	if (success)
+	{
+		region->block_table = load_block_table((char *)mapping + table_start,
+				header->capacity, header->size);
+		success = NULL != region->block_table;
+	}
+
+	if (success)
+	{
+		region->size = header->size;
+		region->data = (char *)mapping + header->data_offset;
+		region->backing = create ? SHARED_BACKING : ATTACHED_BACKING;
+		region->mapping = mapping;
+		region->mapping_size = mapping_size;
+	}
+	else
+	{
+		if (MAP_FAILED != mapping)
+		{
+			munmap(mapping, mapping_size);
+		}
+
+		if (create && 0 <= fd)
+		{
+			shm_unlink(name);
+		}
+	}
+
+	if (0 <= fd)
+	{
+		close(fd);
+	}
+
+	return success;
+}
+
+/* Shared regions keep bytes_used in the segment. Locking loads it into the
+ * region node, unlocking stores it back. */
+
+void lock_backing(region_node * region)
+{
+	assert(NULL != region);
+
+	shared_header * header;
+
+	if (NULL != region && (SHARED_BACKING == region->backing
+				|| ATTACHED_BACKING == region->backing))
+	{
+		header = region->mapping;
+
+		if (EOWNERDEAD == pthread_mutex_lock(&header->lock))
+		{
+			header->bytes_used = table_bytes_used(region->block_table);
+			pthread_mutex_consistent(&header->lock);
+		}
+
+		region->bytes_used = header->bytes_used;
+	}
+}
+
+void unlock_backing(region_node * region)
+{
+	assert(NULL != region);
+
+	shared_header * header;
+
+	if (NULL != region && (SHARED_BACKING == region->backing
+				|| ATTACHED_BACKING == region->backing))
+	{
+		header = region->mapping;
+		header->bytes_used = region->bytes_used;
+
+		pthread_mutex_unlock(&header->lock);
+	}
+}
+
+/* Give a heap region's whole pages back to the system before it is freed.
+ * Mappings are returned by munmap and children belong to their parent, so
+ * only heap data needs this. */
+
+void decommit_backing(region_node * region)
+{
+	assert(NULL != region);
+
+	uintptr_t page_size = sysconf(_SC_PAGESIZE);
+	uintptr_t first_page;
+	uintptr_t last_page;
+
+	if (NULL != region && HEAP_BACKING == region->backing && NULL != region->data)
+	{
+		first_page = ((uintptr_t)region->data + page_size - 1) & ~(page_size - 1);
+		last_page = ((uintptr_t)region->data + region->size) & ~(page_size - 1);
+
+		if (first_page < last_page)
+		{
+			madvise((void *)first_page, last_page - first_page, MADV_DONTNEED);
+		}
+	}
+}
+
+void release_backing(region_node * region)
+{
+	assert(NULL != region);
+
+	char name[NAME_MAX];
+
+	if (NULL != region)
+	{
+		prefault_wait(region);
+
+		if (HEAP_BACKING == region->backing)
+		{
+			free(region->block_table);
+			free(region->data);
+		}
+		else if (CHILD_BACKING == region->backing)
+		{
+			free(region->block_table);
+		}
+		else if (NULL != region->mapping)
+		{
+			if (NUMA_BACKING == region->backing || MEMFD_BACKING == region->backing
+					|| CLONE_BACKING == region->backing)
+			{
+				free(region->block_table);
+			}
+
+			munmap(region->mapping, region->mapping_size);
+		}
+
+		if (-1 != region->fd)
+		{
+			close(region->fd);
+		}
+
+		if (SHARED_BACKING == region->backing && shared_name(region->name, name))
+		{
+			shm_unlink(name);
+		}
+
+		/* A pool's slot bitmap goes with its data */
+
+		if (NULL != region->pool)
+		{
+			destroy_pool(region->pool);
+		}
+
+		if (NULL != region->frames)
+		{
+			destroy_frames(region->frames);
+		}
+
+		if (NULL != region->large)
+		{
+			destroy_large_objects(region->large);
+		}
+
+		if (NULL != region->gap_index)
+		{
+			destroy_gap_index(region->gap_index);
+		}
+
+		region->data = NULL;
+		region->block_table = NULL;
+		region->pool = NULL;
+		region->frames = NULL;
+		region->gap_index = NULL;
+		region->mapping = NULL;
+		region->mapping_size = 0;
+	}
+}
+
+unsigned int round_to_alignment(unsigned int input)
+{
+	return (input + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+}
+
+boolean shared_name(const char * region_name, char * name)
+{
+	assert(NULL != region_name);
+
+	boolean success = NULL != region_name && NULL == strchr(region_name, '/')
+		&& strlen(region_name) + 1 < NAME_MAX;
+
+	if (success)
+	{
+		name[0] = '/';
+		strcpy(name + 1, region_name);
+	}
+
+	return success;
+}
+
+boolean init_shared_lock(pthread_mutex_t * lock)
+{
+	pthread_mutexattr_t attributes;
+	boolean success = 0 == pthread_mutexattr_init(&attributes);
+
+	if (success)
+	{
+		success = 0 == pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED)
+			&& 0 == pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST)
+			&& 0 == pthread_mutex_init(lock, &attributes);
+
+		pthread_mutexattr_destroy(&attributes);
+	}
+
+	return success;
+}
@@ -0,0 +1,31 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef _BACKING_H
+#define _BACKING_H
+
+typedef struct REGION_NODE region_node;
+
+boolean heap_backing(region_node * region, rsize_t region_size);
+boolean numa_backing(region_node * region, rsize_t region_size, numa_policy policy, int node);
+boolean memfd_backing(region_node * region, rsize_t region_size, numa_policy policy, int node);
+boolean clone_backing(region_node * clone, region_node * source);
+boolean file_backing(region_node * region, const char * path, rsize_t region_size);
+boolean child_backing(region_node * region, void * data_start, rsize_t region_size);
+boolean shared_backing(region_node * region, rsize_t region_size, boolean create);
+void lock_backing(region_node * region);
+void unlock_backing(region_node * region);
+void decommit_backing(region_node * region);
+void release_backing(region_node * region);
+
+#endif
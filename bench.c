@@ -0,0 +1,817 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "regions.h"
+
+#define MAX_BLOCKS 8191
+#define RANDOM_COUNT 65536
+#define CHURN_REGIONS 64
+#define SEARCH_REGIONS 16
+#define VECTOR_PUSHES 16000
+#define MAP_KEYS 1536
+#define MAP_SLOTS 2048
+#define QUEUE_PUSHES 8000
+#define FRAME_BLOCKS 300
+#define GOLDEN_RATIO 0x9E3779B97F4A7C15ULL
+#define COUNTER_COUNT 6
+#define CACHE_READ_MISS(cache) ((cache) | PERF_COUNT_HW_CACHE_OP_READ << 8 \
+		| PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+
+/* Allocator benchmarks. Each workload prints its time per operation; the
+ * total at the end is what the build variants are compared on. The same
+ * workloads train the profile guided build.
+ *
+ * "regions-bench -c" also reads hardware counters around each workload
+ * and prints them per operation, so a layout change can be told apart
+ * from an algorithmic one. Counters the machine or kernel will not give
+ * show as "-"; page faults come from getrusage and are always there. */
+
+typedef struct WORKLOAD workload;
+
+struct WORKLOAD
+{
+	const char * name;
+	unsigned long (* run)(int rounds);
+	int rounds;
+};
+
+/* Heap backed versions of the region containers, built the same way, so
+ * the container workloads compare where the storage comes from. */
+
+typedef struct HEAP_MAP heap_map;
+
+struct HEAP_MAP
+{
+	unsigned long long * keys;
+	void ** values;
+	unsigned char * states;
+};
+
+typedef struct COUNTER counter;
+
+struct COUNTER
+{
+	const char * name;
+	unsigned int type;
+	unsigned long long config;
+	int fd;
+};
+
+static counter counters[COUNTER_COUNT] = {
+	{ "CYCLES", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1 },
+	{ "INSNS", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1 },
+	{ "L1D MISS", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D), -1 },
+	{ "LLC MISS", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL), -1 },
+	{ "DTLB MISS", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB), -1 },
+	{ "BR MISS", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1 },
+};
+
+static void * blocks[MAX_BLOCKS];
+static unsigned short random_values[RANDOM_COUNT];
+
+unsigned long fill_and_free(int rounds);
+unsigned long mixed_sizes(int rounds);
+unsigned long size_lookups(int rounds);
+unsigned long region_churn(int rounds);
+unsigned long pool_objects(int rounds);
+unsigned long search_free(int rounds);
+unsigned long region_vector_push(int rounds);
+unsigned long heap_vector_push(int rounds);
+unsigned long region_map_ops(int rounds);
+unsigned long heap_map_ops(int rounds);
+unsigned long region_deque_queue(int rounds);
+unsigned long heap_deque_queue(int rounds);
+unsigned long frame_ralloc(int rounds);
+unsigned long frame_fixed(int rounds);
+unsigned int heap_map_slot(heap_map * map, unsigned long long key);
+int open_counters();
+void start_counters();
+void stop_counters(double counts[]);
+long page_faults();
+double seconds_now();
+
+int main(int argc, char * argv[])
+{
+	workload workloads[] = {
+		{ "fill and free", fill_and_free, 40 },
+		{ "mixed sizes", mixed_sizes, 20 },
+		{ "size lookups", size_lookups, 200 },
+		{ "region churn", region_churn, 400 },
+		{ "pool objects", pool_objects, 200 },
+		{ "search free", search_free, 40 },
+		{ "vector push", region_vector_push, 200 },
+		{ "heap vector push", heap_vector_push, 200 },
+		{ "map ops", region_map_ops, 400 },
+		{ "heap map ops", heap_map_ops, 400 },
+		{ "deque queue", region_deque_queue, 200 },
+		{ "heap deque queue", heap_deque_queue, 200 },
+		{ "frame ralloc", frame_ralloc, 4000 },
+		{ "frame fixed", frame_fixed, 4000 },
+	};
+	int workload_count = sizeof(workloads) / sizeof(workloads[0]);
+	int counting = 1 < argc && strcmp(argv[1], "-c") == 0;
+	double scale = 1 + counting < argc ? atof(argv[1 + counting]) : 1.0;
+	double total = 0.0;
+	double counts[COUNTER_COUNT];
+	double start;
+	double elapsed;
+	unsigned long operations;
+	long faults = 0;
+	int rounds;
+	int i;
+	int j;
+
+	srand(1);
+
+	for (i = 0; i < RANDOM_COUNT; i++)
+	{
+		random_values[i] = rand();
+	}
+
+	if (counting && 0 == open_counters())
+	{
+		printf("No hardware counters here; only page faults are counted.\n\n");
+	}
+
+	printf("%-16s %12s %10s %10s", "WORKLOAD", "OPERATIONS", "SECONDS", "NS/OP");
+
+	for (j = 0; counting && j < COUNTER_COUNT; j++)
+	{
+		printf(" %10s", counters[j].name);
+	}
+
+	printf(counting ? " %10s\n" : "\n", "FAULTS");
+
+	for (i = 0; i < workload_count; i++)
+	{
+		rounds = 0 < scale * workloads[i].rounds ? scale * workloads[i].rounds : 1;
+
+		if (counting)
+		{
+			faults = page_faults();
+			start_counters();
+		}
+
+		start = seconds_now();
+		operations = workloads[i].run(rounds);
+		elapsed = seconds_now() - start;
+		total += elapsed;
+
+		if (counting)
+		{
+			stop_counters(counts);
+			faults = page_faults() - faults;
+		}
+
+		printf("%-16s %12lu %10.4f", workloads[i].name, operations, elapsed);
+
+		/* A workload that could not run reports no operations, so it has
+		 * no per operation figures */
+
+		if (0 < operations)
+		{
+			printf(" %10.1f", elapsed * 1e9 / operations);
+		}
+		else
+		{
+			printf(" %10s", "-");
+		}
+
+		for (j = 0; counting && j < COUNTER_COUNT; j++)
+		{
+			if (0 <= counts[j] && 0 < operations)
+			{
+				printf(" %10.3f", counts[j] / operations);
+			}
+			else
+			{
+				printf(" %10s", "-");
+			}
+		}
+
+		if (counting && 0 < operations)
+		{
+			printf(" %10.4f", (double)faults / operations);
+		}
+		else if (counting)
+		{
+			printf(" %10s", "-");
+		}
+
+		printf("\n");
+	}
+
+	printf("%-16s %12s %10.4f\n", "total", "", total);
+
+	return EXIT_SUCCESS;
+}
+
+/* Fill a whole region with the smallest blocks, then free them all. */
+
+unsigned long fill_and_free(int rounds)
+{
+	unsigned long operations = 0;
+	int round;
+	int i;
+
+	rinit("Bench", -1);
+
+	for (round = 0; round < rounds; round++)
+	{
+		for (i = 0; i < MAX_BLOCKS; i++)
+		{
+			blocks[i] = ralloc(8);
+		}
+
+		for (i = 0; i < MAX_BLOCKS; i += 2)
+		{
+			rfree(blocks[i]);
+		}
+
+		for (i = 1; i < MAX_BLOCKS; i += 2)
+		{
+			rfree(blocks[i]);
+		}
+
+		operations += 2 * MAX_BLOCKS;
+	}
+
+	rdestroy("Bench");
+
+	return operations;
+}
+
+/* Random sizes, freed in random order, keeping the region about half
+ * full. */
+
+unsigned long mixed_sizes(int rounds)
+{
+	unsigned long operations = 0;
+	unsigned int next_random = 0;
+	int live = 0;
+	int victim;
+	int round;
+	int i;
+
+	rinit("Bench", -1);
+
+	for (round = 0; round < rounds; round++)
+	{
+		for (i = 0; i < 20000; i++)
+		{
+			next_random = (next_random + 1) % RANDOM_COUNT;
+
+			if (0 < live && (random_values[next_random] & 1 || live == MAX_BLOCKS))
+			{
+				victim = random_values[next_random] % live;
+				rfree(blocks[victim]);
+				blocks[victim] = blocks[--live];
+			}
+			else
+			{
+				blocks[live] = ralloc(8 + random_values[next_random] % 120);
+
+				if (NULL != blocks[live])
+				{
+					live++;
+				}
+			}
+		}
+
+		operations += 20000;
+	}
+
+	rdestroy("Bench");
+
+	return operations;
+}
+
+/* rsize on every block of a full region. */
+
+unsigned long size_lookups(int rounds)
+{
+	unsigned long operations = 0;
+	unsigned long sizes = 0;
+	int count = 0;
+	int round;
+	int i;
+
+	rinit("Bench", -1);
+
+	while (count < MAX_BLOCKS && NULL != (blocks[count] = ralloc(8 + 8 * (count % 4))))
+	{
+		count++;
+	}
+
+	for (round = 0; round < rounds; round++)
+	{
+		for (i = 0; i < count; i++)
+		{
+			sizes += rsize(blocks[i]);
+		}
+
+		operations += count;
+	}
+
+	rdestroy("Bench");
+
+	return 0 < sizes ? operations : 0;
+}
+
+/* Short lived regions, as a request handler would use them. */
+
+unsigned long region_churn(int rounds)
+{
+	unsigned long operations = 0;
+	char name[16];
+	int round;
+	int i;
+	int j;
+
+	for (round = 0; round < rounds; round++)
+	{
+		for (i = 0; i < CHURN_REGIONS; i++)
+		{
+			sprintf(name, "Churn %d", i);
+			rinit(name, 4096);
+
+			for (j = 0; j < 16; j++)
+			{
+				ralloc(64);
+			}
+		}
+
+		for (i = CHURN_REGIONS - 1; 0 <= i; i--)
+		{
+			sprintf(name, "Churn %d", i);
+			rdestroy(name);
+		}
+
+		operations += CHURN_REGIONS * 18;
+	}
+
+	return operations;
+}
+
+unsigned long pool_objects(int rounds)
+{
+	unsigned long operations = 0;
+	int round;
+	int i;
+
+	rinit_pool("Bench", 32, 2000);
+
+	for (round = 0; round < rounds; round++)
+	{
+		for (i = 0; i < 2000; i++)
+		{
+			blocks[i] = ralloc(32);
+		}
+
+		for (i = 0; i < 2000; i++)
+		{
+			rfree(blocks[random_values[i] % 2000]);
+			rfree(blocks[i]);
+		}
+
+		operations += 6000;
+	}
+
+	rdestroy("Bench");
+
+	return operations;
+}
+
+/* rfree has to find the owning region among several. */
+
+unsigned long search_free(int rounds)
+{
+	unsigned long operations = 0;
+	char name[16];
+	int round;
+	int i;
+
+	for (i = 0; i < SEARCH_REGIONS; i++)
+	{
+		sprintf(name, "Search %d", i);
+		rinit(name, -1);
+	}
+
+	for (round = 0; round < rounds; round++)
+	{
+		for (i = 0; i < 4096; i++)
+		{
+			sprintf(name, "Search %d", i % SEARCH_REGIONS);
+			rchoose(name);
+			blocks[i] = ralloc(16);
+		}
+
+		for (i = 0; i < 4096; i++)
+		{
+			rfree(blocks[i]);
+		}
+
+		operations += 2 * 4096;
+	}
+
+	for (i = 0; i < SEARCH_REGIONS; i++)
+	{
+		sprintf(name, "Search %d", i);
+		rdestroy(name);
+	}
+
+	return operations;
+}
+
+/* Push onto a vector from its smallest size, then read it back. */
+
+unsigned long region_vector_push(int rounds)
+{
+	region_vector vector;
+	unsigned long sum = 0;
+	int round;
+	int i;
+
+	for (round = 0; round < rounds; round++)
+	{
+		rinit("Bench", -1);
+		rvec_init(&vector, sizeof(int), 0);
+
+		for (i = 0; i < VECTOR_PUSHES; i++)
+		{
+			rvec_push(&vector, &i);
+		}
+
+		for (i = 0; i < VECTOR_PUSHES; i++)
+		{
+			sum += *(int *)rvec_at(&vector, i);
+		}
+
+		rdestroy("Bench");
+	}
+
+	return 0 < sum ? (unsigned long)rounds * 2 * VECTOR_PUSHES : 0;
+}
+
+unsigned long heap_vector_push(int rounds)
+{
+	unsigned long sum = 0;
+	int * data;
+	int capacity;
+	int count;
+	int round;
+	int i;
+
+	for (round = 0; round < rounds; round++)
+	{
+		capacity = 8;
+		count = 0;
+		data = malloc(capacity * sizeof(int));
+
+		for (i = 0; i < VECTOR_PUSHES; i++)
+		{
+			if (count == capacity)
+			{
+				capacity *= 2;
+				data = realloc(data, capacity * sizeof(int));
+			}
+
+			data[count++] = i;
+		}
+
+		for (i = 0; i < VECTOR_PUSHES; i++)
+		{
+			sum += data[i];
+		}
+
+		free(data);
+	}
+
+	return 0 < sum ? (unsigned long)rounds * 2 * VECTOR_PUSHES : 0;
+}
+
+/* Fill a map to three quarters, look every key up, then remove half. */
+
+unsigned long region_map_ops(int rounds)
+{
+	region_map map;
+	unsigned long found = 0;
+	int round;
+	int i;
+
+	for (round = 0; round < rounds; round++)
+	{
+		rinit("Bench", -1);
+		rmap_init(&map, MAP_SLOTS);
+
+		for (i = 0; i < MAP_KEYS; i++)
+		{
+			rmap_put(&map, i * 7919ULL, blocks);
+		}
+
+		for (i = 0; i < MAP_KEYS; i++)
+		{
+			found += rmap_get(&map, i * 7919ULL, NULL);
+		}
+
+		for (i = 0; i < MAP_KEYS; i += 2)
+		{
+			rmap_remove(&map, i * 7919ULL);
+		}
+
+		rdestroy("Bench");
+	}
+
+	return 0 < found ? (unsigned long)rounds * (2 * MAP_KEYS + MAP_KEYS / 2) : 0;
+}
+
+unsigned long heap_map_ops(int rounds)
+{
+	heap_map map;
+	unsigned long found = 0;
+	unsigned int slot;
+	int round;
+	int i;
+
+	for (round = 0; round < rounds; round++)
+	{
+		map.keys = malloc(MAP_SLOTS * sizeof(unsigned long long));
+		map.values = malloc(MAP_SLOTS * sizeof(void *));
+		map.states = calloc(MAP_SLOTS, 1);
+
+		for (i = 0; i < MAP_KEYS; i++)
+		{
+			slot = heap_map_slot(&map, i * 7919ULL);
+			map.keys[slot] = i * 7919ULL;
+			map.values[slot] = blocks;
+			map.states[slot] = 1;
+		}
+
+		for (i = 0; i < MAP_KEYS; i++)
+		{
+			found += 1 == map.states[heap_map_slot(&map, i * 7919ULL)];
+		}
+
+		for (i = 0; i < MAP_KEYS; i += 2)
+		{
+			map.states[heap_map_slot(&map, i * 7919ULL)] = 2;
+		}
+
+		free(map.keys);
+		free(map.values);
+		free(map.states);
+	}
+
+	return 0 < found ? (unsigned long)rounds * (2 * MAP_KEYS + MAP_KEYS / 2) : 0;
+}
+
+/* A work queue: two pushes at the back for every pop at the front. */
+
+unsigned long region_deque_queue(int rounds)
+{
+	region_deque deque;
+	unsigned long sum = 0;
+	int element;
+	int round;
+	int i;
+
+	for (round = 0; round < rounds; round++)
+	{
+		rinit("Bench", -1);
+		rdeque_init(&deque, sizeof(int), 0);
+
+		for (i = 0; i < QUEUE_PUSHES; i++)
+		{
+			rdeque_push_back(&deque, &i);
+			rdeque_push_back(&deque, &i);
+			rdeque_pop_front(&deque, &element);
+			sum += element;
+		}
+
+		rdestroy("Bench");
+	}
+
+	return 0 < sum ? (unsigned long)rounds * 3 * QUEUE_PUSHES : 0;
+}
+
+unsigned long heap_deque_queue(int rounds)
+{
+	unsigned long sum = 0;
+	int * data;
+	int capacity;
+	int head;
+	int count;
+	int round;
+	int i;
+	int j;
+
+	for (round = 0; round < rounds; round++)
+	{
+		capacity = 8;
+		head = 0;
+		count = 0;
+		data = malloc(capacity * sizeof(int));
+
+		for (i = 0; i < QUEUE_PUSHES; i++)
+		{
+			for (j = 0; j < 2; j++)
+			{
+				if (count == capacity)
+				{
+					data = realloc(data, 2 * capacity * sizeof(int));
+					memmove(data + capacity + head, data + head,
+							(capacity - head) * sizeof(int));
+					head += capacity;
+					capacity *= 2;
+				}
+
+				data[(head + count++) % capacity] = i;
+			}
+
+			sum += data[head];
+			head = (head + 1) % capacity;
+			count--;
+		}
+
+		free(data);
+	}
+
+	return 0 < sum ? (unsigned long)rounds * 3 * QUEUE_PUSHES : 0;
+}
+
+/* Per-tick allocation of one small struct size, through ralloc and then
+ * through the compile time rounded fast path. */
+
+unsigned long frame_ralloc(int rounds)
+{
+	unsigned long allocated = 0;
+	int round;
+	int i;
+
+	rinit_frames("Bench", 8192, 2);
+
+	for (round = 0; round < rounds; round++)
+	{
+		for (i = 0; i < FRAME_BLOCKS; i++)
+		{
+			allocated += NULL != ralloc(24);
+		}
+
+		rframe_advance();
+	}
+
+	rdestroy("Bench");
+
+	return allocated;
+}
+
+unsigned long frame_fixed(int rounds)
+{
+	region_handle region;
+	unsigned long allocated = 0;
+	int round;
+	int i;
+
+	rinit_frames("Bench", 8192, 2);
+	region = rhandle("Bench");
+
+	for (round = 0; round < rounds; round++)
+	{
+		for (i = 0; i < FRAME_BLOCKS; i++)
+		{
+			allocated += NULL != RALLOC_FIXED(region, 24);
+		}
+
+		rframe_advance();
+	}
+
+	rdestroy("Bench");
+
+	return allocated;
+}
+
+/* The region map's probe, without deleted slot reuse, which the heap
+ * workload never needs. */
+
+unsigned int heap_map_slot(heap_map * map, unsigned long long key)
+{
+	unsigned int slot = (key * GOLDEN_RATIO >> 32) & (MAP_SLOTS - 1);
+
+	while (0 != map->states[slot] && !(1 == map->states[slot] && key == map->keys[slot]))
+	{
+		slot = (slot + 1) & (MAP_SLOTS - 1);
+	}
+
+	return slot;
+}
+
+/* Each counter is its own event rather than one group, so a machine
+ * that lacks one still gives the rest. User space only, which is all an
+ * unprivileged process may count under the default perf_event_paranoid.
+ * Returns how many counters opened. */
+
+int open_counters()
+{
+	struct perf_event_attr attributes;
+	int opened = 0;
+	int i;
+
+	for (i = 0; i < COUNTER_COUNT; i++)
+	{
+		memset(&attributes, 0, sizeof(attributes));
+		attributes.size = sizeof(attributes);
+		attributes.type = counters[i].type;
+		attributes.config = counters[i].config;
+		attributes.disabled = 1;
+		attributes.exclude_kernel = 1;
+		attributes.exclude_hv = 1;
+		attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		counters[i].fd = syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+
+		if (-1 != counters[i].fd)
+		{
+			opened++;
+		}
+	}
+
+	return opened;
+}
+
+void start_counters()
+{
+	int i;
+
+	for (i = 0; i < COUNTER_COUNT; i++)
+	{
+		if (-1 != counters[i].fd)
+		{
+			ioctl(counters[i].fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(counters[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+/* More counters than the PMU has are time shared, so each count is scaled
+ * up by how long it actually ran. A count of -1 means not available. */
+
+void stop_counters(double counts[])
+{
+	unsigned long long reading[3];
+	int i;
+
+	for (i = 0; i < COUNTER_COUNT; i++)
+	{
+		counts[i] = -1;
+
+		if (-1 != counters[i].fd)
+		{
+			ioctl(counters[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+		}
+
+		if (-1 != counters[i].fd && sizeof(reading) == read(counters[i].fd, reading, sizeof(reading))
+				&& 0 < reading[2])
+		{
+			counts[i] = (double)reading[0] * reading[1] / reading[2];
+		}
+	}
+}
+
+long page_faults()
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	return usage.ru_minflt + usage.ru_majflt;
+}
+
+double seconds_now()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
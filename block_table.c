@@ -0,0 +1,637 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "globals.h"
+
+#define NO_BLOCK 0xFFFF
+
+typedef struct BLOCK_TABLE block_table;
+
+/* Block table: count offsets sorted by address, followed by their sizes
+ * and then their stamps. Everything is relative to the start of the region
+ * data, so the table holds no pointers. Each block is stamped with the
+ * clock when it was added, which gives the allocation order. */
+
+struct BLOCK_TABLE
+{
+	rsize_t count;
+	rsize_t capacity;
+	unsigned int clock;
+	rsize_t entries[];
+};
+
+rsize_t * table_offsets(block_table * table);
+rsize_t * table_sizes(block_table * table);
+unsigned int * table_stamps(block_table * table);
+rsize_t table_index(block_table * table, rsize_t offset);
+rsize_t first_gap(block_table * table, rsize_t block_size);
+
+unsigned int table_bytes(rsize_t capacity)
+{
+	return sizeof(block_table) + 2 * capacity * sizeof(rsize_t)
+		+ capacity * sizeof(unsigned int);
+}
+
+block_table * new_block_table(void * buffer, rsize_t capacity)
+{
+	assert(NULL != buffer);
+	assert(0 < capacity);
+
+	block_table * table = NULL;
+
+	if (NULL != buffer && 0 < capacity)
+	{
+		table = buffer;
+		table->count = 0;
+		table->capacity = capacity;
+		table->clock = 0;
+	}
+
+	return table;
+}
+
+block_table * alloc_block_table(rsize_t capacity)
+{
+	assert(0 < capacity);
+
+	block_table * table = NULL;
+
+	if (0 < capacity)
+	{
+		table = malloc(table_bytes(capacity));
+		assert(NULL != table);
+
+		if (NULL != table)
+		{
+			new_block_table(table, capacity);
+		}
+	}
+
+	return table;
+}
+
+/* Double a heap allocated table, up to max_capacity. The sizes and stamps
+ * follow the offsets, so they move up to their new places, stamps first.
+ * Returns the table unchanged if it cannot grow. */
+
+block_table * grow_block_table(block_table * table, rsize_t max_capacity)
+{
+	assert(NULL != table);
+
+	block_table * grown = table;
+	rsize_t capacity;
+
+	if (NULL != table && table->capacity < max_capacity)
+	{
+		capacity = table->capacity < max_capacity / 2 ? table->capacity * 2 : max_capacity;
+		grown = realloc(table, table_bytes(capacity));
+
+		if (NULL != grown)
+		{
+			memmove(grown->entries + 2 * capacity, grown->entries + 2 * grown->capacity,
+					grown->count * sizeof(unsigned int));
+			memmove(grown->entries + capacity, grown->entries + grown->capacity,
+					grown->count * sizeof(rsize_t));
+			grown->capacity = capacity;
+		}
+		else
+		{
+			grown = table;
+		}
+	}
+
+	return grown;
+}
+
+/* A heap allocated copy of any table, at the same capacity. */
+
+block_table * copy_block_table(block_table * table)
+{
+	assert(NULL != table);
+
+	block_table * copy = NULL;
+
+	if (NULL != table)
+	{
+		copy = malloc(table_bytes(table->capacity));
+		assert(NULL != copy);
+	}
+
+	if (NULL != copy)
+	{
+		memcpy(copy, table, table_bytes(table->capacity));
+	}
+
+	return copy;
+}
+
+boolean table_full(block_table * table)
+{
+	return NULL != table && table->count == table->capacity;
+}
+
+/* A table read back from a file or shared segment is only trusted if its
+ * blocks are sorted, aligned and stamped, and all lie in data_size bytes. */
+
+block_table * load_block_table(void * buffer, rsize_t capacity, rsize_t data_size)
+{
+	assert(NULL != buffer);
+
+	block_table * table = buffer;
+	rsize_t * offsets;
+	rsize_t * sizes;
+	unsigned int * stamps;
+	rsize_t i;
+	boolean valid = NULL != buffer
+		&& capacity == table->capacity
+		&& table->count <= table->capacity;
+
+	if (valid)
+	{
+		offsets = table_offsets(table);
+		sizes = table_sizes(table);
+		stamps = table_stamps(table);
+
+		for (i = 0; valid && i < table->count; i++)
+		{
+			valid = 0 < sizes[i] && 0 == offsets[i] % BLOCK_ALIGNMENT
+				&& stamps[i] <= table->clock
+				&& (0 == i || offsets[i - 1] + sizes[i - 1] <= offsets[i]);
+		}
+
+		valid = valid && (0 == table->count
+				|| offsets[table->count - 1] + sizes[table->count - 1] <= data_size);
+	}
+
+	if (!valid)
+	{
+		table = NULL;
+	}
+
+	return table;
+}
+
+rsize_t table_add(block_table * table, rsize_t block_size, rsize_t data_size)
+{
+	assert(NULL != table);
+	assert(0 == block_size % BLOCK_ALIGNMENT);
+	assert(0 < block_size);
+
+	rsize_t block_start = NO_BLOCK;
+	rsize_t * offsets;
+	rsize_t * sizes;
+	unsigned int * stamps;
+	unsigned int prev_end = 0;
+	rsize_t i;
+
+	if (NULL != table && 0 < block_size && table->count < table->capacity)
+	{
+		offsets = table_offsets(table);
+		sizes = table_sizes(table);
+		stamps = table_stamps(table);
+
+		i = first_gap(table, block_size);
+
+		if (0 < i)
+		{
+			prev_end = offsets[i - 1] + sizes[i - 1];
+		}
+
+		if (i < table->count || data_size - prev_end >= block_size)
+		{
+			memmove(&offsets[i + 1], &offsets[i], (table->count - i) * sizeof(rsize_t));
+			memmove(&sizes[i + 1], &sizes[i], (table->count - i) * sizeof(rsize_t));
+			memmove(&stamps[i + 1], &stamps[i], (table->count - i) * sizeof(unsigned int));
+
+			offsets[i] = prev_end;
+			sizes[i] = block_size;
+			stamps[i] = ++table->clock;
+			table->count++;
+
+			block_start = prev_end;
+		}
+	}
+
+	return block_start;
+}
+
+/* Insert a block at an offset chosen by the caller, such as one found by
+ * a gap index. The block must not overlap its neighbours. */
+
+boolean table_insert(block_table * table, rsize_t offset, rsize_t block_size)
+{
+	assert(NULL != table);
+	assert(0 == offset % BLOCK_ALIGNMENT);
+	assert(0 < block_size);
+
+	boolean success = false;
+	rsize_t * offsets;
+	rsize_t * sizes;
+	unsigned int * stamps;
+	rsize_t i;
+
+	if (NULL != table && 0 < block_size && table->count < table->capacity)
+	{
+		offsets = table_offsets(table);
+		sizes = table_sizes(table);
+		stamps = table_stamps(table);
+		i = table_index(table, offset);
+
+		success = (0 == i || offsets[i - 1] + sizes[i - 1] <= offset)
+			&& (i == table->count || offset + block_size <= offsets[i]);
+		assert(success);
+
+		if (success)
+		{
+			memmove(&offsets[i + 1], &offsets[i], (table->count - i) * sizeof(rsize_t));
+			memmove(&sizes[i + 1], &sizes[i], (table->count - i) * sizeof(rsize_t));
+			memmove(&stamps[i + 1], &stamps[i], (table->count - i) * sizeof(unsigned int));
+
+			offsets[i] = offset;
+			sizes[i] = block_size;
+			stamps[i] = ++table->clock;
+			table->count++;
+		}
+	}
+
+	return success;
+}
+
+/* Offset of the first gap that fits at or after from, wrapping around to
+ * the start of the region, or NO_BLOCK. */
+
+rsize_t table_next_gap(block_table * table, rsize_t block_size, rsize_t data_size, rsize_t from)
+{
+	assert(NULL != table);
+	assert(0 < block_size);
+
+	rsize_t block_start = NO_BLOCK;
+	rsize_t * offsets;
+	rsize_t * sizes;
+	unsigned int gap_start;
+	unsigned int gap_end;
+	unsigned int i;
+	int pass;
+
+	if (NULL != table && 0 < block_size)
+	{
+		offsets = table_offsets(table);
+		sizes = table_sizes(table);
+		i = table_index(table, from);
+
+		for (pass = 0; NO_BLOCK == block_start && pass < 2; pass++)
+		{
+			for (; NO_BLOCK == block_start && i <= table->count; i++)
+			{
+				gap_start = 0 < i ? offsets[i - 1] + sizes[i - 1] : 0;
+				gap_start = gap_start < from ? from : gap_start;
+				gap_end = i < table->count ? offsets[i] : data_size;
+
+				if (gap_start + block_size <= gap_end)
+				{
+					block_start = gap_start;
+				}
+			}
+
+			i = 0;
+			from = 0;
+		}
+	}
+
+	return block_start;
+}
+
+/* Offset of the smallest gap that fits, the lowest one on ties, or
+ * NO_BLOCK. */
+
+rsize_t table_best_gap(block_table * table, rsize_t block_size, rsize_t data_size)
+{
+	assert(NULL != table);
+	assert(0 < block_size);
+
+	rsize_t block_start = NO_BLOCK;
+	rsize_t * offsets;
+	rsize_t * sizes;
+	unsigned int best_size = data_size + 1;
+	unsigned int gap_start;
+	unsigned int gap_end;
+	unsigned int i;
+
+	if (NULL != table && 0 < block_size)
+	{
+		offsets = table_offsets(table);
+		sizes = table_sizes(table);
+
+		for (i = 0; i <= table->count && best_size != block_size; i++)
+		{
+			gap_start = 0 < i ? offsets[i - 1] + sizes[i - 1] : 0;
+			gap_end = i < table->count ? offsets[i] : data_size;
+
+			if (gap_start + block_size <= gap_end && gap_end - gap_start < best_size)
+			{
+				best_size = gap_end - gap_start;
+				block_start = gap_start;
+			}
+		}
+	}
+
+	return block_start;
+}
+
+rsize_t table_find(block_table * table, rsize_t offset)
+{
+	assert(NULL != table);
+
+	rsize_t block_size = 0;
+	rsize_t i;
+
+	if (NULL != table)
+	{
+		i = table_index(table, offset);
+
+		if (i < table->count && offset == table_offsets(table)[i])
+		{
+			block_size = table_sizes(table)[i];
+		}
+	}
+
+	return block_size;
+}
+
+boolean table_delete(block_table * table, rsize_t offset)
+{
+	assert(NULL != table);
+
+	boolean success = false;
+	rsize_t * offsets;
+	rsize_t * sizes;
+	unsigned int * stamps;
+	rsize_t i;
+
+	if (NULL != table)
+	{
+		offsets = table_offsets(table);
+		sizes = table_sizes(table);
+		stamps = table_stamps(table);
+		i = table_index(table, offset);
+
+		success = i < table->count && offset == offsets[i];
+
+		if (success)
+		{
+			table->count--;
+			memmove(&offsets[i], &offsets[i + 1], (table->count - i) * sizeof(rsize_t));
+			memmove(&sizes[i], &sizes[i + 1], (table->count - i) * sizeof(rsize_t));
+			memmove(&stamps[i], &stamps[i + 1], (table->count - i) * sizeof(unsigned int));
+		}
+	}
+
+	return success;
+}
+
+/* Change a block's size where it stands. Fails if it would run into the
+ * next block or past data_size. */
+
+boolean table_resize(block_table * table, rsize_t offset, rsize_t block_size, rsize_t data_size)
+{
+	assert(NULL != table);
+	assert(0 < block_size);
+
+	boolean success = false;
+	rsize_t * offsets;
+	unsigned int limit;
+	rsize_t i;
+
+	if (NULL != table && 0 < block_size)
+	{
+		offsets = table_offsets(table);
+		i = table_index(table, offset);
+
+		if (i < table->count && offset == offsets[i])
+		{
+			limit = i + 1 < table->count ? offsets[i + 1] : data_size;
+			success = (unsigned int)offset + block_size <= limit;
+		}
+
+		if (success)
+		{
+			table_sizes(table)[i] = block_size;
+		}
+	}
+
+	return success;
+}
+
+/* Drop every block stamped after clock in a single pass that slides the
+ * survivors down. Returns the number of blocks dropped. */
+
+rsize_t table_truncate(block_table * table, unsigned int clock)
+{
+	assert(NULL != table);
+
+	rsize_t dropped = 0;
+	rsize_t * offsets;
+	rsize_t * sizes;
+	unsigned int * stamps;
+	rsize_t kept = 0;
+	rsize_t i;
+
+	if (NULL != table)
+	{
+		offsets = table_offsets(table);
+		sizes = table_sizes(table);
+		stamps = table_stamps(table);
+
+		for (i = 0; i < table->count; i++)
+		{
+			if (stamps[i] <= clock)
+			{
+				offsets[kept] = offsets[i];
+				sizes[kept] = sizes[i];
+				stamps[kept] = stamps[i];
+				kept++;
+			}
+		}
+
+		dropped = table->count - kept;
+		table->count = kept;
+	}
+
+	return dropped;
+}
+
+rsize_t table_count(block_table * table)
+{
+	return NULL != table ? table->count : 0;
+}
+
+rsize_t table_offset(block_table * table, rsize_t index)
+{
+	assert(NULL != table && index < table->count);
+
+	return table_offsets(table)[index];
+}
+
+rsize_t table_size(block_table * table, rsize_t index)
+{
+	assert(NULL != table && index < table->count);
+
+	return table_sizes(table)[index];
+}
+
+unsigned int table_stamp(block_table * table, rsize_t index)
+{
+	assert(NULL != table && index < table->count);
+
+	return table_stamps(table)[index];
+}
+
+unsigned int table_clock(block_table * table)
+{
+	return NULL != table ? table->clock : 0;
+}
+
+rsize_t table_bytes_used(block_table * table)
+{
+	assert(NULL != table);
+
+	unsigned int bytes_used = 0;
+	rsize_t i;
+
+	for (i = 0; NULL != table && i < table->count; i++)
+	{
+		bytes_used += table_sizes(table)[i];
+	}
+
+	return bytes_used;
+}
+
+rsize_t * table_offsets(block_table * table)
+{
+	return table->entries;
+}
+
+rsize_t * table_sizes(block_table * table)
+{
+	return table->entries + table->capacity;
+}
+
+unsigned int * table_stamps(block_table * table)
+{
+	return (unsigned int *)(table->entries + 2 * table->capacity);
+}
+
+/* Index of the first block at or after offset. The search halves the
+ * range with a conditional add instead of a branch, so it does not
+ * mispredict on random lookups. */
+
+rsize_t table_index(block_table * table, rsize_t offset)
+{
+	rsize_t * offsets = table_offsets(table);
+	rsize_t * base = offsets;
+	rsize_t remaining = table->count;
+	rsize_t half;
+	rsize_t index = 0;
+
+	if (0 < remaining)
+	{
+		while (1 < remaining)
+		{
+			half = remaining / 2;
+			base += base[half] < offset ? half : 0;
+			remaining -= half;
+		}
+
+		index = (base - offsets) + (*base < offset);
+	}
+
+	return index;
+}
+
+/* Index of the first block with a gap of at least block_size in front of
+ * it, or count if only the space after the last block is left. With SSE2
+ * the gaps in front of eight blocks are checked at once: each block's
+ * offset minus the end of the block before it, compared with a
+ * saturating subtract. */
+
+rsize_t first_gap(block_table * table, rsize_t block_size)
+{
+	rsize_t * offsets = table_offsets(table);
+	rsize_t * sizes = table_sizes(table);
+	rsize_t i = 0;
+	boolean found = 0 < table->count && offsets[0] >= block_size;
+
+#ifdef __SSE2__
+	__m128i wanted = _mm_set1_epi16(block_size);
+	__m128i zero = _mm_setzero_si128();
+	__m128i starts;
+	__m128i prev_ends;
+	__m128i short_gaps;
+	int fits;
+
+	if (!found)
+	{
+		i = 1;
+
+		while (!found && i + 8 <= table->count)
+		{
+			starts = _mm_loadu_si128((__m128i *)&offsets[i]);
+			prev_ends = _mm_add_epi16(_mm_loadu_si128((__m128i *)&offsets[i - 1]),
+					_mm_loadu_si128((__m128i *)&sizes[i - 1]));
+			short_gaps = _mm_subs_epu16(wanted, _mm_sub_epi16(starts, prev_ends));
+			fits = _mm_movemask_epi8(_mm_cmpeq_epi16(short_gaps, zero));
+
+			if (0 != fits)
+			{
+				i += __builtin_ctz(fits) / 2;
+				found = true;
+			}
+			else
+			{
+				i += 8;
+			}
+		}
+	}
+#else
+	if (!found)
+	{
+		i = 1;
+	}
+#endif
+
+	while (!found && i < table->count)
+	{
+		found = offsets[i] - (offsets[i - 1] + sizes[i - 1]) >= block_size;
+
+		if (!found)
+		{
+			i++;
+		}
+	}
+
+	if (!found)
+	{
+		i = table->count;
+	}
+
+	return i;
+}
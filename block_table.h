@@ -0,0 +1,48 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef _BLOCKTABLE_H
+#define _BLOCKTABLE_H
+
+/* A block table keeps a region's blocks as region-relative offsets, sorted
+ * by address, in parallel arrays of offsets, sizes and allocation stamps.
+ * It holds no pointers, so it can also live inside a file or shared
+ * mapping. */
+
+#define NO_BLOCK 0xFFFF
+
+typedef struct BLOCK_TABLE block_table;
+
+unsigned int table_bytes(rsize_t capacity);
+block_table * new_block_table(void * buffer, rsize_t capacity);
+block_table * alloc_block_table(rsize_t capacity);
+block_table * grow_block_table(block_table * table, rsize_t max_capacity);
+block_table * load_block_table(void * buffer, rsize_t capacity, rsize_t data_size);
+block_table * copy_block_table(block_table * table);
+boolean table_full(block_table * table);
+rsize_t table_add(block_table * table, rsize_t block_size, rsize_t data_size);
+boolean table_insert(block_table * table, rsize_t offset, rsize_t block_size);
+rsize_t table_next_gap(block_table * table, rsize_t block_size, rsize_t data_size, rsize_t from);
+rsize_t table_best_gap(block_table * table, rsize_t block_size, rsize_t data_size);
+rsize_t table_find(block_table * table, rsize_t offset);
+boolean table_delete(block_table * table, rsize_t offset);
+boolean table_resize(block_table * table, rsize_t offset, rsize_t block_size, rsize_t data_size);
+rsize_t table_truncate(block_table * table, unsigned int clock);
+rsize_t table_count(block_table * table);
+rsize_t table_offset(block_table * table, rsize_t index);
+rsize_t table_size(block_table * table, rsize_t index);
+unsigned int table_stamp(block_table * table, rsize_t index);
+unsigned int table_clock(block_table * table);
+rsize_t table_bytes_used(block_table * table);
+
+#endif
@@ -0,0 +1,549 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "regions.h"
+
+#define NO_SLOT 0xFFFF
+#define MIN_ELEMENTS 8
+#define MAP_MAX_SLOTS 2048
+#define GOLDEN_RATIO 0x9E3779B97F4A7C15ULL
+
+/* Containers whose storage is a single block in one region. They never
+ * touch the heap, and destroying the region releases them with the rest
+ * of its blocks. Each container stays with the region chosen when it was
+ * made. */
+
+typedef enum SLOT_STATE
+{
+	SLOT_EMPTY,
+	SLOT_FULL,
+	SLOT_DELETED
+} slot_state;
+
+region_handle rchosen_handle();
+boolean rvec_grow(region_vector * vector);
+boolean rmap_rehash(region_map * map, rsize_t capacity);
+rsize_t rmap_slot(region_map * map, unsigned long long key, boolean * found);
+boolean rdeque_grow(region_deque * deque);
+rsize_t grown_capacity(rsize_t capacity, rsize_t element_size);
+
+/* Vector: elements side by side, doubling through rrealloc_in so that the
+ * last block in a region grows where it is. */
+
+boolean rvec_init(region_vector * vector, rsize_t element_size, rsize_t capacity)
+{
+	assert(NULL != vector);
+	assert(0 < element_size);
+	assert(NULL != rchosen_handle());
+
+	boolean success = false;
+
+	capacity = 0 < capacity ? capacity : MIN_ELEMENTS;
+
+	if (NULL != vector && 0 < element_size && NULL != rchosen_handle()
+			&& (unsigned int)element_size * capacity <= RBLOCK_MAX)
+	{
+		vector->region = rchosen_handle();
+		vector->data = ralloc_in(vector->region, element_size * capacity);
+		vector->element_size = element_size;
+		vector->count = 0;
+		vector->capacity = capacity;
+
+		success = NULL != vector->data;
+	}
+
+	return success;
+}
+
+boolean rvec_push(region_vector * vector, const void * element)
+{
+	assert(NULL != vector && NULL != vector->data);
+	assert(NULL != element);
+
+	boolean success = NULL != vector && NULL != vector->data && NULL != element
+		&& (vector->count < vector->capacity || rvec_grow(vector));
+
+	if (success)
+	{
+		memcpy(vector->data + vector->count * vector->element_size, element,
+				vector->element_size);
+		vector->count++;
+	}
+
+	return success;
+}
+
+boolean rvec_pop(region_vector * vector, void * element)
+{
+	assert(NULL != vector);
+
+	boolean success = NULL != vector && 0 < vector->count;
+
+	if (success)
+	{
+		vector->count--;
+
+		if (NULL != element)
+		{
+			memcpy(element, vector->data + vector->count * vector->element_size,
+					vector->element_size);
+		}
+	}
+
+	return success;
+}
+
+void * rvec_at(region_vector * vector, rsize_t index)
+{
+	assert(NULL != vector);
+
+	void * element = NULL;
+
+	if (NULL != vector && index < vector->count)
+	{
+		element = vector->data + index * vector->element_size;
+	}
+
+	return element;
+}
+
+void rvec_free(region_vector * vector)
+{
+	assert(NULL != vector);
+
+	if (NULL != vector && NULL != vector->data)
+	{
+		rfree_in(vector->region, vector->data);
+
+		vector->data = NULL;
+		vector->count = 0;
+		vector->capacity = 0;
+	}
+}
+
+/* Map: open addressing with linear probing over parallel arrays of keys,
+ * values and slot states, all in one block. Removed keys leave a deleted
+ * slot behind until the next rehash, which happens when full and deleted
+ * slots together pass three quarters of the table. */
+
+boolean rmap_init(region_map * map, rsize_t capacity)
+{
+	assert(NULL != map);
+	assert(NULL != rchosen_handle());
+
+	boolean success = false;
+	rsize_t slots = MIN_ELEMENTS;
+
+	while (slots < MAP_MAX_SLOTS && slots < capacity)
+	{
+		slots *= 2;
+	}
+
+	if (NULL != map && NULL != rchosen_handle())
+	{
+		map->region = rchosen_handle();
+		map->keys = NULL;
+		map->values = NULL;
+		map->states = NULL;
+		map->count = 0;
+		map->used = 0;
+		map->capacity = 0;
+
+		success = rmap_rehash(map, slots);
+	}
+
+	return success;
+}
+
+boolean rmap_put(region_map * map, unsigned long long key, void * value)
+{
+	assert(NULL != map && NULL != map->keys);
+
+	boolean success = false;
+	boolean found = false;
+	rsize_t capacity;
+	rsize_t slot;
+
+	if (NULL != map && NULL != map->keys)
+	{
+		slot = rmap_slot(map, key, &found);
+		success = true;
+
+		/* Double once over half full, otherwise just clear deleted slots.
+		 * A full map stays at three quarters, so probes always end. */
+
+		if (!found && 4 * (map->used + 1) > 3 * map->capacity)
+		{
+			capacity = map->capacity;
+
+			if (2 * (map->count + 1) > capacity && capacity < MAP_MAX_SLOTS)
+			{
+				capacity *= 2;
+			}
+
+			rmap_rehash(map, capacity);
+			slot = rmap_slot(map, key, &found);
+			success = 4 * (map->used + 1) <= 3 * map->capacity;
+		}
+	}
+
+	if (success)
+	{
+		if (!found)
+		{
+			map->used += SLOT_EMPTY == map->states[slot];
+			map->count++;
+			map->keys[slot] = key;
+			map->states[slot] = SLOT_FULL;
+		}
+
+		map->values[slot] = value;
+	}
+
+	return success;
+}
+
+boolean rmap_get(region_map * map, unsigned long long key, void ** value)
+{
+	assert(NULL != map && NULL != map->keys);
+
+	boolean found = false;
+	rsize_t slot;
+
+	if (NULL != map && NULL != map->keys)
+	{
+		slot = rmap_slot(map, key, &found);
+
+		if (found && NULL != value)
+		{
+			*value = map->values[slot];
+		}
+	}
+
+	return found;
+}
+
+boolean rmap_remove(region_map * map, unsigned long long key)
+{
+	assert(NULL != map && NULL != map->keys);
+
+	boolean found = false;
+	rsize_t slot;
+
+	if (NULL != map && NULL != map->keys)
+	{
+		slot = rmap_slot(map, key, &found);
+
+		if (found)
+		{
+			map->states[slot] = SLOT_DELETED;
+			map->count--;
+		}
+	}
+
+	return found;
+}
+
+void rmap_free(region_map * map)
+{
+	assert(NULL != map);
+
+	if (NULL != map && NULL != map->keys)
+	{
+		rfree_in(map->region, map->keys);
+
+		map->keys = NULL;
+		map->values = NULL;
+		map->states = NULL;
+		map->count = 0;
+		map->used = 0;
+		map->capacity = 0;
+	}
+}
+
+/* Deque: a ring of elements starting at head, grown like a vector. When
+ * the ring wraps, the part from head to the old end moves to the end of
+ * the grown block. */
+
+boolean rdeque_init(region_deque * deque, rsize_t element_size, rsize_t capacity)
+{
+	assert(NULL != deque);
+	assert(0 < element_size);
+	assert(NULL != rchosen_handle());
+
+	boolean success = false;
+
+	capacity = 0 < capacity ? capacity : MIN_ELEMENTS;
+
+	if (NULL != deque && 0 < element_size && NULL != rchosen_handle()
+			&& (unsigned int)element_size * capacity <= RBLOCK_MAX)
+	{
+		deque->region = rchosen_handle();
+		deque->data = ralloc_in(deque->region, element_size * capacity);
+		deque->element_size = element_size;
+		deque->head = 0;
+		deque->count = 0;
+		deque->capacity = capacity;
+
+		success = NULL != deque->data;
+	}
+
+	return success;
+}
+
+boolean rdeque_push_back(region_deque * deque, const void * element)
+{
+	assert(NULL != deque && NULL != deque->data);
+	assert(NULL != element);
+
+	boolean success = NULL != deque && NULL != deque->data && NULL != element
+		&& (deque->count < deque->capacity || rdeque_grow(deque));
+
+	if (success)
+	{
+		memcpy(deque->data + (deque->head + deque->count) % deque->capacity
+				* deque->element_size, element, deque->element_size);
+		deque->count++;
+	}
+
+	return success;
+}
+
+boolean rdeque_push_front(region_deque * deque, const void * element)
+{
+	assert(NULL != deque && NULL != deque->data);
+	assert(NULL != element);
+
+	boolean success = NULL != deque && NULL != deque->data && NULL != element
+		&& (deque->count < deque->capacity || rdeque_grow(deque));
+
+	if (success)
+	{
+		deque->head = (deque->head + deque->capacity - 1) % deque->capacity;
+		memcpy(deque->data + deque->head * deque->element_size, element,
+				deque->element_size);
+		deque->count++;
+	}
+
+	return success;
+}
+
+boolean rdeque_pop_front(region_deque * deque, void * element)
+{
+	assert(NULL != deque);
+
+	boolean success = NULL != deque && 0 < deque->count;
+
+	if (success)
+	{
+		if (NULL != element)
+		{
+			memcpy(element, deque->data + deque->head * deque->element_size,
+					deque->element_size);
+		}
+
+		deque->head = (deque->head + 1) % deque->capacity;
+		deque->count--;
+	}
+
+	return success;
+}
+
+boolean rdeque_pop_back(region_deque * deque, void * element)
+{
+	assert(NULL != deque);
+
+	boolean success = NULL != deque && 0 < deque->count;
+
+	if (success)
+	{
+		deque->count--;
+
+		if (NULL != element)
+		{
+			memcpy(element, deque->data + (deque->head + deque->count) % deque->capacity
+					* deque->element_size, deque->element_size);
+		}
+	}
+
+	return success;
+}
+
+void * rdeque_at(region_deque * deque, rsize_t index)
+{
+	assert(NULL != deque);
+
+	void * element = NULL;
+
+	if (NULL != deque && index < deque->count)
+	{
+		element = deque->data + (deque->head + index) % deque->capacity * deque->element_size;
+	}
+
+	return element;
+}
+
+void rdeque_free(region_deque * deque)
+{
+	assert(NULL != deque);
+
+	if (NULL != deque && NULL != deque->data)
+	{
+		rfree_in(deque->region, deque->data);
+
+		deque->data = NULL;
+		deque->head = 0;
+		deque->count = 0;
+		deque->capacity = 0;
+	}
+}
+
+boolean rvec_grow(region_vector * vector)
+{
+	rsize_t capacity = grown_capacity(vector->capacity, vector->element_size);
+	char * grown = NULL;
+
+	if (vector->capacity < capacity)
+	{
+		grown = rrealloc_in(vector->region, vector->data, capacity * vector->element_size);
+	}
+
+	if (NULL != grown)
+	{
+		vector->data = grown;
+		vector->capacity = capacity;
+	}
+
+	return NULL != grown;
+}
+
+/* Move every key into a fresh block of capacity slots, dropping deleted
+ * slots on the way. */
+
+boolean rmap_rehash(region_map * map, rsize_t capacity)
+{
+	boolean success = capacity <= MAP_MAX_SLOTS && map->count < capacity;
+	region_map grown;
+	boolean found;
+	rsize_t slot;
+	rsize_t i;
+
+	if (success)
+	{
+		grown = *map;
+		grown.keys = ralloc_in(map->region, capacity * (sizeof(unsigned long long)
+					+ sizeof(void *) + 1));
+		success = NULL != grown.keys;
+	}
+
+	if (success)
+	{
+		grown.values = (void **)(grown.keys + capacity);
+		grown.states = (unsigned char *)(grown.values + capacity);
+		grown.capacity = capacity;
+		grown.used = map->count;
+
+		for (i = 0; i < map->capacity; i++)
+		{
+			if (SLOT_FULL == map->states[i])
+			{
+				slot = rmap_slot(&grown, map->keys[i], &found);
+				grown.keys[slot] = map->keys[i];
+				grown.values[slot] = map->values[i];
+				grown.states[slot] = SLOT_FULL;
+			}
+		}
+
+		if (NULL != map->keys)
+		{
+			rfree_in(map->region, map->keys);
+		}
+
+		*map = grown;
+	}
+
+	return success;
+}
+
+/* Slot holding key, or the slot it would go in: the first deleted slot
+ * passed on the way, else the empty slot that ended the probe. */
+
+rsize_t rmap_slot(region_map * map, unsigned long long key, boolean * found)
+{
+	rsize_t mask = map->capacity - 1;
+	rsize_t slot = (key * GOLDEN_RATIO >> 32) & mask;
+	rsize_t reusable = NO_SLOT;
+
+	*found = false;
+
+	while (!*found && SLOT_EMPTY != map->states[slot])
+	{
+		if (SLOT_FULL == map->states[slot] && key == map->keys[slot])
+		{
+			*found = true;
+		}
+		else
+		{
+			if (SLOT_DELETED == map->states[slot] && NO_SLOT == reusable)
+			{
+				reusable = slot;
+			}
+
+			slot = (slot + 1) & mask;
+		}
+	}
+
+	return !*found && NO_SLOT != reusable ? reusable : slot;
+}
+
+boolean rdeque_grow(region_deque * deque)
+{
+	rsize_t capacity = grown_capacity(deque->capacity, deque->element_size);
+	rsize_t wrapped;
+	char * grown = NULL;
+
+	if (deque->capacity < capacity)
+	{
+		grown = rrealloc_in(deque->region, deque->data, capacity * deque->element_size);
+	}
+
+	if (NULL != grown)
+	{
+		if (deque->capacity < deque->head + deque->count)
+		{
+			wrapped = deque->capacity - deque->head;
+			memmove(grown + (capacity - wrapped) * deque->element_size,
+					grown + deque->head * deque->element_size, wrapped * deque->element_size);
+			deque->head = capacity - wrapped;
+		}
+
+		deque->data = grown;
+		deque->capacity = capacity;
+	}
+
+	return NULL != grown;
+}
+
+/* Double, as far as one block allows. */
+
+rsize_t grown_capacity(rsize_t capacity, rsize_t element_size)
+{
+	unsigned int limit = RBLOCK_MAX / element_size;
+
+	return 2 * (unsigned int)capacity < limit ? 2 * capacity : limit;
+}
@@ -0,0 +1,146 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "globals.h"
+
+#define NO_ROOM 0xFFFF
+
+typedef struct FRAMES frames;
+
+/* Frames: the region data holds frame_count frames of frame_size bytes,
+ * one after another. Each frame only remembers how far it is filled and
+ * how many blocks it gave out, so emptying one is two stores. */
+
+struct FRAMES
+{
+	rsize_t frame_size;
+	rsize_t frame_count;
+	rsize_t current;
+	rsize_t * block_counts;
+	rsize_t tops[];
+};
+
+frames * new_frames(rsize_t frame_size, rsize_t frame_count)
+{
+	assert(0 < frame_size);
+	assert(0 < frame_count);
+
+	frames * ring = NULL;
+	rsize_t i;
+
+	if (0 < frame_size && 0 < frame_count)
+	{
+		ring = malloc(sizeof(frames) + 2 * frame_count * sizeof(rsize_t));
+		assert(NULL != ring);
+	}
+
+	if (NULL != ring)
+	{
+		ring->frame_size = frame_size;
+		ring->frame_count = frame_count;
+		ring->current = 0;
+		ring->block_counts = ring->tops + frame_count;
+
+		for (i = 0; i < frame_count; i++)
+		{
+			ring->tops[i] = 0;
+			ring->block_counts[i] = 0;
+		}
+	}
+
+	return ring;
+}
+
+/* Region offset of block_size bytes bumped off the current frame, or
+ * NO_ROOM if the frame is full. */
+
+rsize_t frame_take(frames * ring, rsize_t block_size)
+{
+	assert(NULL != ring);
+	assert(0 < block_size);
+
+	rsize_t block_offset = NO_ROOM;
+
+	if (NULL != ring && 0 < block_size
+			&& block_size <= ring->frame_size - ring->tops[ring->current])
+	{
+		block_offset = ring->current * ring->frame_size + ring->tops[ring->current];
+		ring->tops[ring->current] += block_size;
+		ring->block_counts[ring->current]++;
+	}
+
+	return block_offset;
+}
+
+/* Make the oldest frame current and empty it. Returns the bytes it held. */
+
+rsize_t frame_advance(frames * ring)
+{
+	assert(NULL != ring);
+
+	rsize_t released = 0;
+
+	if (NULL != ring)
+	{
+		ring->current = (ring->current + 1) % ring->frame_count;
+		released = ring->tops[ring->current];
+		ring->tops[ring->current] = 0;
+		ring->block_counts[ring->current] = 0;
+	}
+
+	return released;
+}
+
+rsize_t frame_current(frames * ring)
+{
+	assert(NULL != ring);
+
+	return ring->current;
+}
+
+rsize_t frame_size(frames * ring)
+{
+	assert(NULL != ring);
+
+	return ring->frame_size;
+}
+
+rsize_t frame_count(frames * ring)
+{
+	assert(NULL != ring);
+
+	return ring->frame_count;
+}
+
+rsize_t frame_bytes_used(frames * ring, rsize_t frame)
+{
+	assert(NULL != ring && frame < ring->frame_count);
+
+	return ring->tops[frame];
+}
+
+rsize_t frame_block_count(frames * ring, rsize_t frame)
+{
+	assert(NULL != ring && frame < ring->frame_count);
+
+	return ring->block_counts[frame];
+}
+
+void destroy_frames(frames * ring)
+{
+	free(ring);
+}
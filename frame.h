@@ -0,0 +1,34 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef _FRAME_H
+#define _FRAME_H
+
+/* Frames split a region into equal sub-arenas that are bump allocated in
+ * turn. Advancing empties the oldest frame and makes it current. */
+
+#define NO_ROOM 0xFFFF
+
+typedef struct FRAMES frames;
+
+frames * new_frames(rsize_t frame_size, rsize_t frame_count);
+rsize_t frame_take(frames * ring, rsize_t block_size);
+rsize_t frame_advance(frames * ring);
+rsize_t frame_current(frames * ring);
+rsize_t frame_size(frames * ring);
+rsize_t frame_count(frames * ring);
+rsize_t frame_bytes_used(frames * ring, rsize_t frame);
+rsize_t frame_block_count(frames * ring, rsize_t frame);
+void destroy_frames(frames * ring);
+
+#endif
@@ -0,0 +1,299 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+
+#include "globals.h"
+
+#define NO_GAP 0xFFFF
+#define WORD_BITS 64
+
+typedef struct GAP_INDEX gap_index;
+
+/* Gap index: a bitmap with one bit per aligned granule (set when in use),
+ * and a segment tree over the bitmap words. Each tree node keeps the free
+ * run at the start of its span, the free run at its end, and the longest
+ * free run anywhere inside it, all counted in granules. Node 1 is the
+ * root, node n has children 2n and 2n + 1, and word w is leaf
+ * leaf_count + w. */
+
+struct GAP_INDEX
+{
+	rsize_t granule_count;
+	rsize_t word_count;
+	rsize_t leaf_count;
+	rsize_t * prefix;
+	rsize_t * suffix;
+	rsize_t * longest;
+	uint64_t words[];
+};
+
+void mark_granules(gap_index * gaps, rsize_t offset, rsize_t block_size, boolean used);
+void update_leaf(gap_index * gaps, rsize_t word_index);
+void update_node(gap_index * gaps, rsize_t node, rsize_t child_span);
+rsize_t longest_free_run(uint64_t word);
+rsize_t first_free_run(uint64_t word, rsize_t run);
+
+gap_index * new_gap_index(rsize_t data_size)
+{
+	assert(0 < data_size);
+
+	gap_index * gaps = NULL;
+	rsize_t granule_count = data_size / BLOCK_ALIGNMENT;
+	rsize_t word_count = (granule_count + WORD_BITS - 1) / WORD_BITS;
+	rsize_t leaf_count = 1;
+	rsize_t level;
+	rsize_t node;
+	rsize_t child_span;
+
+	while (leaf_count < word_count)
+	{
+		leaf_count *= 2;
+	}
+
+	if (0 < granule_count)
+	{
+		gaps = malloc(sizeof(gap_index) + leaf_count * sizeof(uint64_t)
+				+ 3 * 2 * leaf_count * sizeof(rsize_t));
+		assert(NULL != gaps);
+	}
+
+	if (NULL != gaps)
+	{
+		gaps->granule_count = granule_count;
+		gaps->word_count = word_count;
+		gaps->leaf_count = leaf_count;
+		gaps->prefix = (rsize_t *)(gaps->words + leaf_count);
+		gaps->suffix = gaps->prefix + 2 * leaf_count;
+		gaps->longest = gaps->suffix + 2 * leaf_count;
+
+		/* Granules past the end of the region are marked in use for good */
+
+		memset(gaps->words, 0xFF, leaf_count * sizeof(uint64_t));
+		memset(gaps->words, 0, granule_count / WORD_BITS * sizeof(uint64_t));
+
+		if (0 != granule_count % WORD_BITS)
+		{
+			gaps->words[granule_count / WORD_BITS] = ~0ULL << (granule_count % WORD_BITS);
+		}
+
+		for (node = 0; node < leaf_count; node++)
+		{
+			update_leaf(gaps, node);
+		}
+
+		for (level = leaf_count / 2, child_span = WORD_BITS; 0 < level; level /= 2, child_span *= 2)
+		{
+			for (node = level; node < 2 * level; node++)
+			{
+				update_node(gaps, node, child_span);
+			}
+		}
+	}
+
+	return gaps;
+}
+
+/* Offset of the lowest free run of at least block_size bytes, or NO_GAP.
+ * The search goes left whenever the left child holds a long enough run,
+ * takes the run that straddles the two children if that is long enough,
+ * and goes right otherwise. */
+
+rsize_t gap_find(gap_index * gaps, rsize_t block_size)
+{
+	assert(NULL != gaps);
+	assert(0 < block_size && 0 == block_size % BLOCK_ALIGNMENT);
+
+	rsize_t offset = NO_GAP;
+	rsize_t run = block_size / BLOCK_ALIGNMENT;
+	rsize_t node = 1;
+	unsigned int start = 0;
+	unsigned int child_span;
+	boolean found = false;
+
+	if (NULL != gaps && 0 < run && run <= gaps->longest[1])
+	{
+		child_span = gaps->leaf_count * WORD_BITS / 2;
+
+		while (!found && node < gaps->leaf_count)
+		{
+			if (gaps->longest[2 * node] >= run)
+			{
+				node = 2 * node;
+			}
+			else if (gaps->suffix[2 * node] + gaps->prefix[2 * node + 1] >= run)
+			{
+				start += child_span - gaps->suffix[2 * node];
+				found = true;
+			}
+			else
+			{
+				node = 2 * node + 1;
+				start += child_span;
+			}
+
+			child_span /= 2;
+		}
+
+		if (!found)
+		{
+			start += first_free_run(gaps->words[node - gaps->leaf_count], run);
+		}
+
+		assert(start + run <= gaps->granule_count);
+		offset = start * BLOCK_ALIGNMENT;
+	}
+
+	return offset;
+}
+
+void gap_fill(gap_index * gaps, rsize_t offset, rsize_t block_size)
+{
+	mark_granules(gaps, offset, block_size, true);
+}
+
+void gap_clear(gap_index * gaps, rsize_t offset, rsize_t block_size)
+{
+	mark_granules(gaps, offset, block_size, false);
+}
+
+void destroy_gap_index(gap_index * gaps)
+{
+	free(gaps);
+}
+
+/* Sets or clears the bits for a block, then refreshes only the tree
+ * nodes above the words it touched. */
+
+void mark_granules(gap_index * gaps, rsize_t offset, rsize_t block_size, boolean used)
+{
+	assert(NULL != gaps);
+	assert(0 == offset % BLOCK_ALIGNMENT && 0 == block_size % BLOCK_ALIGNMENT);
+
+	unsigned int first = offset / BLOCK_ALIGNMENT;
+	unsigned int last = first + block_size / BLOCK_ALIGNMENT;
+	unsigned int low;
+	unsigned int high;
+	rsize_t child_span = WORD_BITS;
+	uint64_t mask;
+	unsigned int i;
+
+	if (NULL != gaps && 0 < block_size && last <= gaps->granule_count)
+	{
+		for (i = first; i < last; i = (i / WORD_BITS + 1) * WORD_BITS)
+		{
+			mask = ~0ULL << (i % WORD_BITS);
+
+			if (last < (i / WORD_BITS + 1) * WORD_BITS)
+			{
+				mask &= ~(~0ULL << (last % WORD_BITS));
+			}
+
+			if (used)
+			{
+				assert(0 == (gaps->words[i / WORD_BITS] & mask));
+				gaps->words[i / WORD_BITS] |= mask;
+			}
+			else
+			{
+				gaps->words[i / WORD_BITS] &= ~mask;
+			}
+
+			update_leaf(gaps, i / WORD_BITS);
+		}
+
+		low = (gaps->leaf_count + first / WORD_BITS) / 2;
+		high = (gaps->leaf_count + (last - 1) / WORD_BITS) / 2;
+
+		while (0 < low)
+		{
+			for (i = low; i <= high; i++)
+			{
+				update_node(gaps, i, child_span);
+			}
+
+			low /= 2;
+			high /= 2;
+			child_span *= 2;
+		}
+	}
+}
+
+void update_leaf(gap_index * gaps, rsize_t word_index)
+{
+	uint64_t word = gaps->words[word_index];
+	rsize_t node = gaps->leaf_count + word_index;
+
+	gaps->prefix[node] = 0 == word ? WORD_BITS : __builtin_ctzll(word);
+	gaps->suffix[node] = 0 == word ? WORD_BITS : __builtin_clzll(word);
+	gaps->longest[node] = longest_free_run(word);
+}
+
+void update_node(gap_index * gaps, rsize_t node, rsize_t child_span)
+{
+	rsize_t left = 2 * node;
+	rsize_t right = 2 * node + 1;
+	rsize_t longest = gaps->suffix[left] + gaps->prefix[right];
+
+	gaps->prefix[node] = gaps->prefix[left] == child_span
+		? child_span + gaps->prefix[right] : gaps->prefix[left];
+	gaps->suffix[node] = gaps->suffix[right] == child_span
+		? child_span + gaps->suffix[left] : gaps->suffix[right];
+
+	longest = longest > gaps->longest[left] ? longest : gaps->longest[left];
+	gaps->longest[node] = longest > gaps->longest[right] ? longest : gaps->longest[right];
+}
+
+/* Each pass keeps only the free bits whose upper neighbour is free too,
+ * so the number of passes is the length of the longest run. */
+
+rsize_t longest_free_run(uint64_t word)
+{
+	uint64_t free_bits = ~word;
+	rsize_t run = 0;
+
+	while (0 != free_bits)
+	{
+		free_bits &= free_bits >> 1;
+		run++;
+	}
+
+	return run;
+}
+
+/* Lowest bit that starts a run of at least run free bits. Shifting by
+ * the length matched so far doubles it each pass. */
+
+rsize_t first_free_run(uint64_t word, rsize_t run)
+{
+	assert(0 < run && run <= WORD_BITS);
+
+	uint64_t starts = ~word;
+	rsize_t matched = 1;
+	rsize_t shift;
+
+	while (matched < run)
+	{
+		shift = matched < run - matched ? matched : run - matched;
+		starts &= starts >> shift;
+		matched += shift;
+	}
+
+	assert(0 != starts);
+
+	return __builtin_ctzll(starts);
+}
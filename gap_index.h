@@ -0,0 +1,30 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef _GAPINDEX_H
+#define _GAPINDEX_H
+
+/* A gap index tracks which aligned granules of a region are in use, and
+ * finds the lowest free run of a given size in logarithmic time. */
+
+#define NO_GAP 0xFFFF
+
+typedef struct GAP_INDEX gap_index;
+
+gap_index * new_gap_index(rsize_t data_size);
+rsize_t gap_find(gap_index * gaps, rsize_t block_size);
+void gap_fill(gap_index * gaps, rsize_t offset, rsize_t block_size);
+void gap_clear(gap_index * gaps, rsize_t offset, rsize_t block_size);
+void destroy_gap_index(gap_index * gaps);
+
+#endif
@@ -14,9 +14,20 @@
 #ifndef _GLOBALS_H
 #define _GLOBALS_H
 
+#include "regions.h"
+
 #define BLOCK_ALIGNMENT 8
 
-typedef enum BOOL { false, true } boolean;
-typedef unsigned short rsize_t;
+typedef enum BACKING
+{
+	HEAP_BACKING,
+	FILE_BACKING,
+	SHARED_BACKING,
+	ATTACHED_BACKING,
+	CHILD_BACKING,
+	NUMA_BACKING,
+	MEMFD_BACKING,
+	CLONE_BACKING
+} region_backing;
 
 #endif
@@ -0,0 +1,595 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "regions.h"
+
+/* malloc and friends on top of regions, for use with LD_PRELOAD. Each
+ * thread allocates small blocks from a region of its own; when that fills
+ * up it starts another. Large blocks get their own anonymous mapping.
+ * Pointers this library did not hand out (such as the ones glibc made
+ * before it was loaded) go back to glibc.
+ *
+ * The region engine is not thread safe and allocates its own bookkeeping
+ * with malloc, so every call takes one lock, and calls made from inside
+ * the engine go straight to glibc. */
+
+#define EXPORT __attribute__((visibility("default")))
+#define SMALL_LIMIT 4096
+#define SMALL_ALIGNMENT 16
+#define REGION_BYTES 65520
+#define INITIAL_RANGES 64
+#define NAME_LENGTH 24
+
+typedef struct RANGE range;
+
+/* One region or large mapping, kept in an array sorted by start so a
+ * pointer's owner is a binary search away. region is NULL for a large
+ * mapping. A region is destroyed when its last block is freed, unless a
+ * thread is still allocating from it. */
+
+struct RANGE
+{
+	char * start;
+	char * end;
+	region_handle region;
+	unsigned int live;
+	boolean current;
+	char name[NAME_LENGTH];
+};
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t count, size_t size);
+extern void * __libc_realloc(void * ptr, size_t size);
+extern void * __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void * ptr);
+
+static pthread_mutex_t shim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t thread_key;
+static boolean thread_key_ready = false;
+static range * ranges = NULL;
+static unsigned int range_count = 0;
+static unsigned int range_capacity = 0;
+static unsigned int region_counter = 0;
+static size_t page_size = 4096;
+static size_t (* libc_usable_size)(void * ptr) = NULL;
+static __thread int shim_depth = 0;
+static __thread char * thread_region = NULL;
+
+void * region_malloc(size_t size);
+void * large_malloc(size_t size);
+void * aligned_malloc(size_t alignment, size_t size);
+boolean shim_free(void * ptr);
+range * new_thread_region();
+void release_range(range * entry, void * ptr);
+range * find_range(const char * ptr);
+range * insert_range(char * start, char * end, region_handle region);
+void remove_range(range * entry);
+void enter_shim();
+void leave_shim();
+void lock_before_fork();
+void unlock_after_fork();
+void thread_exit(void * region_start);
+
+__attribute__((constructor))
+void shim_init()
+{
+	shim_depth++;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	libc_usable_size = (size_t (*)(void *))dlsym(RTLD_NEXT, "malloc_usable_size");
+	pthread_atfork(lock_before_fork, unlock_after_fork, unlock_after_fork);
+
+	shim_depth--;
+}
+
+EXPORT void * malloc(size_t size)
+{
+	void * block;
+
+	if (0 < shim_depth)
+	{
+		return __libc_malloc(size);
+	}
+
+	enter_shim();
+	block = region_malloc(size);
+	leave_shim();
+
+	if (NULL == block)
+	{
+		errno = ENOMEM;
+	}
+
+	return block;
+}
+
+EXPORT void free(void * ptr)
+{
+	if (NULL != ptr && (0 < shim_depth || !shim_free(ptr)))
+	{
+		__libc_free(ptr);
+	}
+}
+
+/* Region blocks and fresh mappings are already zeroed. */
+
+EXPORT void * calloc(size_t count, size_t size)
+{
+	if (0 < shim_depth)
+	{
+		return __libc_calloc(count, size);
+	}
+
+	if (0 != size && count > SIZE_MAX / size)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return malloc(count * size);
+}
+
+EXPORT void * realloc(void * ptr, size_t size)
+{
+	void * block = NULL;
+	range * entry;
+	size_t old_size = 0;
+	boolean owned = false;
+
+	if (0 < shim_depth)
+	{
+		return __libc_realloc(ptr, size);
+	}
+
+	if (NULL == ptr)
+	{
+		return malloc(size);
+	}
+
+	if (0 == size)
+	{
+		free(ptr);
+		return NULL;
+	}
+
+	enter_shim();
+
+	entry = find_range(ptr);
+	owned = NULL != entry;
+
+	if (owned)
+	{
+		old_size = NULL != entry->region ? rsize_in(entry->region, ptr) : entry->end - entry->start;
+
+		if (size <= old_size)
+		{
+			block = ptr;
+		}
+		else
+		{
+			block = region_malloc(size);
+
+			if (NULL != block)
+			{
+				memcpy(block, ptr, old_size);
+				release_range(find_range(ptr), ptr);
+			}
+		}
+	}
+
+	leave_shim();
+
+	if (!owned)
+	{
+		block = __libc_realloc(ptr, size);
+	}
+	else if (NULL == block)
+	{
+		errno = ENOMEM;
+	}
+
+	return block;
+}
+
+EXPORT void * reallocarray(void * ptr, size_t count, size_t size)
+{
+	if (0 != size && count > SIZE_MAX / size)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return realloc(ptr, count * size);
+}
+
+EXPORT int posix_memalign(void ** memptr, size_t alignment, size_t size)
+{
+	int result = EINVAL;
+
+	if (0 == alignment % sizeof(void *) && 0 == (alignment & (alignment - 1)))
+	{
+		*memptr = aligned_malloc(alignment, size);
+		result = NULL != *memptr ? 0 : ENOMEM;
+	}
+
+	return result;
+}
+
+EXPORT void * aligned_alloc(size_t alignment, size_t size)
+{
+	void * block = NULL;
+
+	if (0 != alignment && 0 == (alignment & (alignment - 1)))
+	{
+		block = aligned_malloc(alignment, size);
+	}
+	else
+	{
+		errno = EINVAL;
+	}
+
+	return block;
+}
+
+EXPORT void * memalign(size_t alignment, size_t size)
+{
+	return aligned_alloc(alignment, size);
+}
+
+EXPORT void * valloc(size_t size)
+{
+	return aligned_malloc(page_size, size);
+}
+
+EXPORT void * pvalloc(size_t size)
+{
+	return aligned_malloc(page_size, (size + page_size - 1) / page_size * page_size);
+}
+
+EXPORT size_t malloc_usable_size(void * ptr)
+{
+	size_t usable = 0;
+	range * entry = NULL;
+
+	if (NULL != ptr && 0 == shim_depth)
+	{
+		enter_shim();
+
+		entry = find_range(ptr);
+
+		if (NULL != entry)
+		{
+			usable = NULL != entry->region ? rsize_in(entry->region, ptr)
+				: (size_t)(entry->end - entry->start);
+		}
+
+		leave_shim();
+	}
+
+	if (NULL != ptr && NULL == entry && NULL != libc_usable_size)
+	{
+		usable = libc_usable_size(ptr);
+	}
+
+	return usable;
+}
+
+/* Called with the lock held from here down. */
+
+void * region_malloc(size_t size)
+{
+	range * entry = NULL;
+	void * block = NULL;
+
+	size = 0 < size ? (size + SMALL_ALIGNMENT - 1) / SMALL_ALIGNMENT * SMALL_ALIGNMENT
+		: SMALL_ALIGNMENT;
+
+	if (size > SMALL_LIMIT)
+	{
+		return large_malloc(size);
+	}
+
+	if (NULL != thread_region)
+	{
+		entry = find_range(thread_region);
+		block = ralloc_in(entry->region, size);
+	}
+
+	if (NULL == block)
+	{
+		entry = new_thread_region();
+		block = NULL != entry ? ralloc_in(entry->region, size) : NULL;
+	}
+
+	if (NULL != block)
+	{
+		entry->live++;
+	}
+
+	return block;
+}
+
+void * large_malloc(size_t size)
+{
+	size_t length = (size + page_size - 1) / page_size * page_size;
+	char * mapping = mmap(NULL, length, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (MAP_FAILED == mapping)
+	{
+		mapping = NULL;
+	}
+	else if (NULL == insert_range(mapping, mapping + length, NULL))
+	{
+		munmap(mapping, length);
+		mapping = NULL;
+	}
+
+	return mapping;
+}
+
+/* Region blocks are 16 byte aligned and mappings are page aligned. Only
+ * alignments beyond a page are left to glibc. */
+
+void * aligned_malloc(size_t alignment, size_t size)
+{
+	void * block;
+
+	if (alignment <= SMALL_ALIGNMENT)
+	{
+		block = malloc(size);
+	}
+	else if (alignment <= page_size && 0 == shim_depth)
+	{
+		enter_shim();
+		block = large_malloc(0 < size ? size : 1);
+		leave_shim();
+	}
+	else
+	{
+		block = __libc_memalign(alignment, size);
+	}
+
+	return block;
+}
+
+boolean shim_free(void * ptr)
+{
+	range * entry;
+
+	enter_shim();
+
+	entry = find_range(ptr);
+
+	if (NULL != entry)
+	{
+		release_range(entry, ptr);
+	}
+
+	leave_shim();
+
+	return NULL != entry;
+}
+
+/* Give the calling thread a fresh region. The one it filled is left to
+ * be destroyed when its last block is freed. */
+
+range * new_thread_region()
+{
+	range * entry = NULL;
+	char name[NAME_LENGTH];
+	char * start;
+
+	if (NULL != thread_region)
+	{
+		entry = find_range(thread_region);
+		entry->current = false;
+		thread_region = NULL;
+
+		if (0 == entry->live)
+		{
+			release_range(entry, NULL);
+		}
+
+		entry = NULL;
+	}
+
+	snprintf(name, NAME_LENGTH, "malloc %u", ++region_counter);
+
+	if (rinit(name, REGION_BYTES))
+	{
+		start = rbase();
+		entry = insert_range(start, start + REGION_BYTES, rhandle(name));
+
+		if (NULL != entry)
+		{
+			strcpy(entry->name, name);
+			entry->current = true;
+			thread_region = start;
+
+			/* malloc can run before the constructor, so the key that
+			 * tells us about exiting threads is made on first use */
+
+			if (!thread_key_ready)
+			{
+				thread_key_ready = 0 == pthread_key_create(&thread_key, thread_exit);
+			}
+
+			if (thread_key_ready)
+			{
+				pthread_setspecific(thread_key, start);
+			}
+		}
+		else
+		{
+			rdestroy(name);
+		}
+	}
+
+	return entry;
+}
+
+/* Free one block of a range, or with ptr NULL, the whole empty range. */
+
+void release_range(range * entry, void * ptr)
+{
+	if (NULL == entry->region)
+	{
+		munmap(entry->start, entry->end - entry->start);
+		remove_range(entry);
+	}
+	else
+	{
+		if (NULL != ptr && rfree_in(entry->region, ptr))
+		{
+			entry->live--;
+		}
+
+		if (0 == entry->live && !entry->current)
+		{
+			rdestroy(entry->name);
+			remove_range(entry);
+		}
+	}
+}
+
+range * find_range(const char * ptr)
+{
+	range * found = NULL;
+	unsigned int low = 0;
+	unsigned int high = range_count;
+	unsigned int middle;
+
+	while (low < high)
+	{
+		middle = low + (high - low) / 2;
+
+		if (ranges[middle].start <= ptr)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	if (0 < low && ptr < ranges[low - 1].end)
+	{
+		found = &ranges[low - 1];
+	}
+
+	return found;
+}
+
+range * insert_range(char * start, char * end, region_handle region)
+{
+	range * grown;
+	range * entry = NULL;
+	unsigned int capacity = 0 < range_capacity ? 2 * range_capacity : INITIAL_RANGES;
+	unsigned int i = range_count;
+
+	if (range_count == range_capacity)
+	{
+		grown = __libc_realloc(ranges, capacity * sizeof(range));
+
+		if (NULL != grown)
+		{
+			ranges = grown;
+			range_capacity = capacity;
+		}
+	}
+
+	if (range_count < range_capacity)
+	{
+		while (0 < i && ranges[i - 1].start > start)
+		{
+			i--;
+		}
+
+		memmove(&ranges[i + 1], &ranges[i], (range_count - i) * sizeof(range));
+		range_count++;
+
+		entry = &ranges[i];
+		entry->start = start;
+		entry->end = end;
+		entry->region = region;
+		entry->live = 0;
+		entry->current = false;
+		entry->name[0] = '\0';
+	}
+
+	return entry;
+}
+
+void remove_range(range * entry)
+{
+	unsigned int i = entry - ranges;
+
+	range_count--;
+	memmove(&ranges[i], &ranges[i + 1], (range_count - i) * sizeof(range));
+}
+
+void enter_shim()
+{
+	pthread_mutex_lock(&shim_lock);
+	shim_depth++;
+}
+
+void leave_shim()
+{
+	shim_depth--;
+	pthread_mutex_unlock(&shim_lock);
+}
+
+void lock_before_fork()
+{
+	pthread_mutex_lock(&shim_lock);
+}
+
+void unlock_after_fork()
+{
+	pthread_mutex_unlock(&shim_lock);
+}
+
+/* A thread that exits stops holding its region open. */
+
+void thread_exit(void * region_start)
+{
+	range * entry;
+
+	enter_shim();
+
+	entry = find_range(region_start);
+
+	if (NULL != entry && entry->current)
+	{
+		entry->current = false;
+		release_range(entry, NULL);
+	}
+
+	leave_shim();
+}
@@ -0,0 +1,228 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "globals.h"
+
+typedef struct LARGE_OBJECTS large_objects;
+typedef struct LARGE_MAPPING large_mapping;
+
+struct LARGE_MAPPING
+{
+	void * data;
+	size_t mapping_size;
+	rsize_t size;
+	large_mapping * next;
+};
+
+struct LARGE_OBJECTS
+{
+	rsize_t threshold;
+	unsigned int count;
+	unsigned int bytes;
+	large_mapping * first;
+};
+
+large_objects * new_large_objects(rsize_t threshold)
+{
+	assert(0 < threshold);
+
+	large_objects * objects = NULL;
+
+	if (0 < threshold)
+	{
+		objects = malloc(sizeof(large_objects));
+		assert(NULL != objects);
+	}
+
+	if (NULL != objects)
+	{
+		objects->threshold = threshold;
+		objects->count = 0;
+		objects->bytes = 0;
+		objects->first = NULL;
+	}
+
+	return objects;
+}
+
+rsize_t large_threshold(large_objects * objects)
+{
+	assert(NULL != objects);
+
+	return objects->threshold;
+}
+
+/* The new mapping comes zeroed, like any other new block */
+
+void * large_take(large_objects * objects, rsize_t object_size)
+{
+	assert(NULL != objects);
+	assert(0 < object_size);
+
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t mapping_size = (object_size + page_size - 1) / page_size * page_size;
+	void * mapping = MAP_FAILED;
+	large_mapping * object = NULL;
+
+	if (NULL != objects && 0 < object_size)
+	{
+		object = malloc(sizeof(large_mapping));
+		assert(NULL != object);
+	}
+
+	if (NULL != object)
+	{
+		mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
+
+	if (MAP_FAILED != mapping)
+	{
+		object->data = mapping;
+		object->mapping_size = mapping_size;
+		object->size = object_size;
+		object->next = objects->first;
+
+		objects->first = object;
+		objects->count++;
+		objects->bytes += object_size;
+	}
+	else
+	{
+		free(object);
+		mapping = NULL;
+	}
+
+	return mapping;
+}
+
+/* The mapping goes back to the system at once */
+
+boolean large_release(large_objects * objects, void * object)
+{
+	assert(NULL != objects);
+
+	boolean success = false;
+	large_mapping ** link = NULL != objects ? &objects->first : NULL;
+	large_mapping * found;
+
+	while (NULL != link && NULL != *link && (*link)->data != object)
+	{
+		link = &(*link)->next;
+	}
+
+	if (NULL != link && NULL != *link)
+	{
+		found = *link;
+		*link = found->next;
+
+		objects->count--;
+		objects->bytes -= found->size;
+
+		munmap(found->data, found->mapping_size);
+		free(found);
+
+		success = true;
+	}
+
+	return success;
+}
+
+rsize_t large_size(large_objects * objects, void * object)
+{
+	assert(NULL != objects);
+
+	large_mapping * current = NULL != objects ? objects->first : NULL;
+
+	while (NULL != current && current->data != object)
+	{
+		current = current->next;
+	}
+
+	return NULL != current ? current->size : 0;
+}
+
+unsigned int large_count(large_objects * objects)
+{
+	assert(NULL != objects);
+
+	return objects->count;
+}
+
+unsigned int large_bytes(large_objects * objects)
+{
+	assert(NULL != objects);
+
+	return objects->bytes;
+}
+
+/* Newest first */
+
+void * large_object(large_objects * objects, unsigned int index)
+{
+	assert(NULL != objects);
+
+	large_mapping * current = NULL != objects ? objects->first : NULL;
+
+	while (NULL != current && 0 < index)
+	{
+		current = current->next;
+		index--;
+	}
+
+	return NULL != current ? current->data : NULL;
+}
+
+/* Visits the objects in list order, stopping when visit returns false. */
+
+boolean large_foreach(large_objects * objects, rblock_visitor visit, void * context)
+{
+	assert(NULL != objects);
+	assert(NULL != visit);
+
+	large_mapping * current = NULL != objects && NULL != visit ? objects->first : NULL;
+	boolean success = true;
+
+	while (NULL != current && success)
+	{
+		success = visit(current->data, current->size, context);
+		current = current->next;
+	}
+
+	return success;
+}
+
+void destroy_large_objects(large_objects * objects)
+{
+	assert(NULL != objects);
+
+	large_mapping * next;
+
+	while (NULL != objects && NULL != objects->first)
+	{
+		next = objects->first->next;
+
+		munmap(objects->first->data, objects->first->mapping_size);
+		free(objects->first);
+
+		objects->first = next;
+	}
+
+	free(objects);
+}
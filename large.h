@@ -0,0 +1,33 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef _LARGE_H
+#define _LARGE_H
+
+/* Blocks above a region's large object threshold each get their own
+ * anonymous mapping, kept in a list beside the region's data. */
+
+typedef struct LARGE_OBJECTS large_objects;
+
+large_objects * new_large_objects(rsize_t threshold);
+rsize_t large_threshold(large_objects * objects);
+void * large_take(large_objects * objects, rsize_t object_size);
+boolean large_release(large_objects * objects, void * object);
+rsize_t large_size(large_objects * objects, void * object);
+unsigned int large_count(large_objects * objects);
+unsigned int large_bytes(large_objects * objects);
+void * large_object(large_objects * objects, unsigned int index);
+boolean large_foreach(large_objects * objects, rblock_visitor visit, void * context);
+void destroy_large_objects(large_objects * objects);
+
+#endif
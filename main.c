@@ -14,15 +14,40 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
 
 #include "regions.h"
-#include "block_list.h"
+#include "trace.h"
 
 void test_init();
 void check(int result);
 void test_typical_cases();
 void test_edge_cases();
 void test_special_cases();
+void test_file_regions();
+void test_shared_regions();
+void test_child_regions();
+void test_async_destroy();
+void test_pool_regions();
+void test_gap_placement();
+void test_numa_regions();
+void test_placement_policies();
+void test_tracing();
+void test_region_handles();
+void test_profiler();
+void test_scratch_marks();
+void test_frame_regions();
+void test_strings();
+void test_containers();
+void test_fixed_sizes();
+void test_offset_pointers();
+void test_region_clones();
+void test_prefaulting();
+void test_large_objects();
+void test_block_walks();
+void test_bulk_operations();
 int free_remaining_blocks(void * blocks[]);
 void print_results();
 
@@ -38,6 +63,50 @@ int main()
 
 	test_special_cases();
 
+	test_file_regions();
+
+	test_shared_regions();
+
+	test_child_regions();
+
+	test_async_destroy();
+
+	test_pool_regions();
+
+	test_gap_placement();
+
+	test_numa_regions();
+
+	test_placement_policies();
+
+	test_tracing();
+
+	test_region_handles();
+
+	test_profiler();
+
+	test_scratch_marks();
+
+	test_frame_regions();
+
+	test_strings();
+
+	test_containers();
+
+	test_fixed_sizes();
+
+	test_offset_pointers();
+
+	test_region_clones();
+
+	test_prefaulting();
+
+	test_large_objects();
+
+	test_block_walks();
+
+	test_bulk_operations();
+
 	print_results();
 
 	printf("\nEnd of Processing.\n");
@@ -65,8 +134,8 @@ void test_typical_cases()
 	int size = 1024;
 	char region_name[12];
 	void * blocks[128];
-	block_node * ptr;
-	unsigned short location;
+	void * ptr;
+	void * location;
 	int i;
 	int j;
 
@@ -273,7 +342,7 @@ void test_typical_cases()
 	check(NULL != ptr);
 	check(ralloc(128) != NULL);
 
-	location = (unsigned short)ptr->block_start;
+	location = ptr;
 
 	check(rfree(ptr));
 	ptr = NULL;
@@ -281,7 +350,7 @@ void test_typical_cases()
 	ptr = ralloc(64);
 	check(NULL != ptr);
 
-	check(location == (unsigned short)ptr->block_start);
+	check(location == ptr);
 
 	rdestroy("Quud");
 	check(rchosen() == NULL);
@@ -293,7 +362,7 @@ void test_edge_cases()
 	int j;
 	char region_name[12];
 	void * blocks[8191];
-	block_node * ptr;
+	void * ptr;
 
 	printf("\n====== Begin Testing Edge Cases. ======\n");
 
@@ -500,6 +569,11 @@ void test_special_cases()
 
 	rdestroy("Dupe");
 
+	check(rinit_shared("regions-dupe-test", 16));
+	check(!rinit_shared("regions-dupe-test", 16));
+
+	rdestroy("regions-dupe-test");
+
 	printf("\nSend abusive parameters to functions (would normally "
 			"trip assertions).\n");
 
@@ -533,29 +607,1687 @@ void test_special_cases()
 	rdump(); // Should print nothing
 }
 
-int free_remaining_blocks(void * blocks[])
+void test_file_regions()
 {
-	int i = 0;
-	int success = 1;
+	char path[] = "/tmp/regions_test_XXXXXX";
+	char * base;
+	void * blocks[3];
+	unsigned short words[512];
+	FILE * not_a_region;
+	int length = 0;
+	int found;
+	int fd;
+	int i;
 
-	while (NULL != blocks[i++])
+	printf("\n====== Begin Testing File Regions. ======\n");
+
+	fd = mkstemp(path);
+	check(0 <= fd);
+	close(fd);
+
+	printf("\nFill a file backed region, destroy it and map it again.\n");
+
+	check(rinit_file("File", path, 256));
+	check(strcmp(rchosen(), "File") == 0);
+
+	blocks[0] = ralloc(16);
+	blocks[1] = ralloc(32);
+	blocks[2] = ralloc(10);
+	check(rfree(blocks[1]));
+	strcpy(blocks[2], "persisted");
+
+	rdestroy("File");
+	check(rchosen() == NULL);
+
+	check(rinit_file("File again", path, 8));
+	base = rbase();
+	check(NULL != base);
+
+	check(rsize(base) == 16);
+	check(rsize(base + 16) == 0);
+	check(rsize(base + 48) == 16);
+	check(strcmp(base + 48, "persisted") == 0);
+
+	check(ralloc(32) == base + 16);		// The freed gap is still free
+	check(ralloc(256) == NULL);		// The size on disk is kept
+
+	rdestroy("File again");
+	check(rchosen() == NULL);
+
+	printf("\nRefuse a file whose last block runs past the region.\n");
+
+	/* The table starts with its count and capacity, then a 4 byte clock,
+	 * the capacity offsets and the sizes. Grow the third block's size. */
+
+	fd = open(path, O_RDWR);
+	check(0 <= fd);
+	found = -1;
+
+	if (0 <= fd)
 	{
-		if (rsize(blocks[i - 1]) > 0)
+		length = pread(fd, words, sizeof(words), 0) / sizeof(unsigned short);
+
+		for (i = 0; i + 1 < length && -1 == found; i++)
 		{
-			check(rfree(blocks[i - 1]));
+			found = 3 == words[i] && 32 == words[i + 1] ? i : -1;
 		}
+	}
 
-		if (rsize(blocks[i - 1]) != 0)
+	check(-1 != found);
+
+	if (-1 != found)
+	{
+		words[found + 4 + 32 + 2] = 216;	// Ends at 264 in 256 bytes
+		check(sizeof(unsigned short) == pwrite(fd, &words[found + 4 + 32 + 2],
+					sizeof(unsigned short), (found + 4 + 32 + 2) * sizeof(unsigned short)));
+		check(!rinit_file("Overrun", path, 256));
+		check(!rchoose("Overrun"));
+	}
+
+	if (0 <= fd)
+	{
+		close(fd);
+	}
+
+	printf("\nTry to map a file that is not a region.\n");
+
+	not_a_region = fopen(path, "w");
+	check(NULL != not_a_region);
+	fprintf(not_a_region, "not a region");
+	fclose(not_a_region);
+
+	check(!rinit_file("Not a region", path, 256));
+	check(!rchoose("Not a region"));
+
+	unlink(path);
+}
+
+void test_shared_regions()
+{
+	char * blocks[256];
+	char * base;
+	char ready;
+	int ready_pipe[2];
+	pid_t child;
+	int status;
+	int child_failures;
+	int i;
+
+	printf("\n====== Begin Testing Shared Regions. ======\n");
+
+	printf("\nAllocate from a shared region in two processes at once.\n");
+
+	check(0 == pipe(ready_pipe));
+	child = fork();
+
+	if (0 == child)
+	{
+		child_failures = 0;
+		close(ready_pipe[1]);
+
+		if (1 != read(ready_pipe[0], &ready, 1) || !rattach("regions-shared-test"))
 		{
-			success = 0;
+			_exit(EXIT_FAILURE);
+		}
+
+		for (i = 0; i < 128; i++)
+		{
+			blocks[i] = ralloc(16);
+			child_failures += NULL == blocks[i];
+
+			if (NULL != blocks[i])
+			{
+				blocks[i][0] = 'c';
+			}
 		}
+
+		check(rfree(blocks[0]));
+		rdestroy("regions-shared-test");
+
+		_exit(0 == child_failures ? EXIT_SUCCESS : EXIT_FAILURE);
 	}
 
-	return success;
+	check(0 < child);
+
+	check(rinit_shared("regions-shared-test", 4096));
+	check(1 == write(ready_pipe[1], "r", 1));
+
+	for (i = 0; i < 128; i++)
+	{
+		blocks[i] = ralloc(16);
+		check(NULL != blocks[i]);
+
+		if (NULL != blocks[i])
+		{
+			blocks[i][0] = 'p';
+		}
+	}
+
+	check(child == waitpid(child, &status, 0));
+	check(WIFEXITED(status) && EXIT_SUCCESS == WEXITSTATUS(status));
+
+	// Every block is still ours, and the child's blocks are all in the region
+
+	base = rbase();
+	child_failures = 0;
+
+	for (i = 0; i < 128; i++)
+	{
+		check(rsize(blocks[i]) == 16);
+		check('p' == blocks[i][0]);
+	}
+
+	for (i = 0; i < 4096; i += 16)
+	{
+		child_failures += rsize(base + i) == 16 && 'c' == base[i];
+	}
+
+	check(127 == child_failures);
+	check(ralloc(16) != NULL);	// Room left by the child's rfree
+	check(ralloc(16) == NULL);
+
+	rdestroy("regions-shared-test");
+	check(rchosen() == NULL);
+	check(!rattach("regions-shared-test"));		// Unlinked by its owner
+
+	close(ready_pipe[0]);
+	close(ready_pipe[1]);
 }
 
-void print_results()
+void test_child_regions()
 {
-	printf("\nTests Failed: %d\n", tests_failed);
+	char * request;
+	char * statement;
+
+	printf("\n====== Begin Testing Child Regions. ======\n");
+
+	printf("\nCarve a child and a grandchild out of a region.\n");
+
+	check(rinit("Request", 1024));
+	request = ralloc(256);
+	check(NULL != request);
+
+	check(rinit_child("Request", "Transaction", 512));
+	check(strcmp(rchosen(), "Transaction") == 0);
+	check(ralloc(128) != NULL);
+
+	check(rinit_child("Transaction", "Statement", 256));
+	statement = ralloc(256);
+	check(NULL != statement);
+	check(rsize(statement) == 256);
+	check(ralloc(1) == NULL);	// Statement is full
+
+	check(rchoose("Transaction"));
+	check(ralloc(256) == NULL);	// Half of Transaction is lent to Statement
+	check(ralloc(128) != NULL);
+
+	check(rchoose("Request"));
+	check(ralloc(512) == NULL);	// Half of Request is lent to Transaction
+	check(ralloc(256) != NULL);
+	check(ralloc(1) == NULL);
+
+	check(!rinit_child("Request", "Too big", 8));
+	check(!rinit_child("Nobody", "Orphan", 8));
+
+	printf("\nDestroy the child, which also destroys the grandchild.\n");
+
+	check(rchoose("Statement"));
+	rdestroy("Transaction");
+	check(rchosen() == NULL);
+	check(!rchoose("Transaction"));
+	check(!rchoose("Statement"));
+
+	check(rchoose("Request"));
+	check(rsize(request) == 256);
+	check(ralloc(512) != NULL);	// The child's data went back to Request
+
+	printf("\nDestroy a parent with several children in one call.\n");
+
+	check(rinit("Request 2", 512));
+	check(rinit_child("Request 2", "Child A", 128));
+	check(rinit_child("Request 2", "Child B", 128));
+	check(rinit_child("Child A", "Grandchild", 64));
+
+	rdestroy("Request 2");
+	check(rchosen() == NULL);
+	check(!rchoose("Child A"));
+	check(!rchoose("Child B"));
+	check(!rchoose("Grandchild"));
+
+	check(rchoose("Request"));
+	rdestroy("Request");
+	check(rchosen() == NULL);
+}
+
+void test_async_destroy()
+{
+	char region_name[12];
+	int i;
+	int j;
+
+	printf("\n====== Begin Testing Asynchronous Destroy. ======\n");
+
+	printf("\nFill 100 regions, destroy them in the background "
+			"and reuse their names right away.\n");
+
+	for (i = 0; i < 100; i++)
+	{
+		sprintf(region_name, "Region %d", i);
+		check(rinit(region_name, 4096));
+
+		for (j = 0; j < 64; j++)
+		{
+			check(ralloc(64) != NULL);
+		}
+	}
+
+	for (i = 0; i < 100; i++)
+	{
+		sprintf(region_name, "Region %d", i);
+		rdestroy_async(region_name);
+		check(!rchoose(region_name));
+	}
+
+	check(rchosen() == NULL);
+
+	for (i = 0; i < 100; i++)
+	{
+		sprintf(region_name, "Region %d", i);
+		check(rinit(region_name, 64));
+		rdestroy_async(region_name);
+	}
+
+	rreclaim_wait();
+
+	printf("\nDestroy a parent in the background while its child is chosen.\n");
+
+	check(rinit("Async parent", 1024));
+	check(rinit_child("Async parent", "Async child", 512));
+	check(ralloc(512) != NULL);
+
+	rdestroy_async("Async parent");
+	check(rchosen() == NULL);
+	check(!rchoose("Async child"));
+
+	rreclaim_wait();
+}
+
+void test_pool_regions()
+{
+	char * objects[8191];
+	char * reused;
+	int i;
+
+	printf("\n====== Begin Testing Pool Regions. ======\n");
+
+	printf("\nFill a pool of 24 byte objects, then free and reuse one.\n");
+
+	check(rinit_pool("Pool", 20, 100));
+	check(strcmp(rchosen(), "Pool") == 0);
+
+	for (i = 0; i < 100; i++)
+	{
+		objects[i] = ralloc(24);
+		check(NULL != objects[i]);
+		check(rsize(objects[i]) == 24);
+	}
+
+	check(objects[99] - objects[0] == 99 * 24);
+	check(ralloc(1) == NULL);	// Pool is full
+
+	check(rfree(objects[70]));
+	check(rsize(objects[70]) == 0);
+	check(!rfree(objects[70]));
+	check(rsize(objects[70] + 8) == 0);	// Not the start of an object
+
+	check(ralloc(32) == NULL);	// Larger than the objects
+	reused = ralloc(1);
+	check(reused == objects[70]);
+
+	rdestroy("Pool");
+	check(rchosen() == NULL);
+
+	printf("\nFill the largest pool of 8 byte objects and free it.\n");
+
+	check(!rinit_pool("Too big", 8, 8192));
+	check(rinit_pool("Big pool", 8, 8191));
+
+	for (i = 0; i < 8191; i++)
+	{
+		objects[i] = ralloc(8);
+		check(NULL != objects[i]);
+	}
+
+	check(ralloc(8) == NULL);
+
+	for (i = 0; i < 8191; i++)
+	{
+		check(rfree(objects[i]));
+	}
+
+	check(ralloc(8) == objects[0]);
+
+	rdestroy("Big pool");
+	check(rchosen() == NULL);
+}
+
+void test_gap_placement()
+{
+	static char * indexed[8191];
+	static char * scanned[8191];
+	char * indexed_base;
+	char * scanned_base;
+	int block_size;
+	int victim;
+	int live = 0;
+	int i;
+
+	printf("\n====== Begin Testing Gap Placement. ======\n");
+
+	printf("\nFill a region with 8 byte blocks and reuse the lowest gap that fits.\n");
+
+	check(rinit("Gaps", -1));
+
+	for (i = 0; i < 8191; i++)
+	{
+		indexed[i] = ralloc(8);
+		check(NULL != indexed[i]);
+	}
+
+	check(ralloc(8) == NULL);
+
+	for (i = 10; i < 13; i++)
+	{
+		check(rfree(indexed[i]));
+	}
+
+	for (i = 60; i < 68; i++)	// Straddles two words of the index
+	{
+		check(rfree(indexed[i]));
+	}
+
+	check(ralloc(64) == indexed[60]);
+	check(ralloc(24) == indexed[10]);
+	check(ralloc(8) == NULL);
+
+	rdestroy("Gaps");
+
+	printf("\nA shared region scans its table; it must place blocks the same way.\n");
+
+	check(rinit("Indexed", 4096));
+	indexed_base = rbase();
+	check(rinit_shared("Scanned", 4096));
+	scanned_base = rbase();
+
+	srand(32);
+
+	for (i = 0; i < 20000; i++)
+	{
+		if (0 < live && (rand() % 2 == 0 || live == 8191))
+		{
+			live--;
+			rchoose("Indexed");
+			check(rfree(indexed[live]));
+			rchoose("Scanned");
+			check(rfree(scanned[live]));
+		}
+		else
+		{
+			block_size = 8 * (1 + rand() % 12);
+			rchoose("Indexed");
+			indexed[live] = ralloc(block_size);
+			rchoose("Scanned");
+			scanned[live] = ralloc(block_size);
+
+			check((NULL == indexed[live]) == (NULL == scanned[live]));
+
+			if (NULL != indexed[live] && NULL != scanned[live])
+			{
+				check(indexed[live] - indexed_base == scanned[live] - scanned_base);
+				live++;
+			}
+		}
+
+		if (0 < live && rand() % 3 == 0)	// Free from the middle too
+		{
+			victim = rand() % live;
+			rchoose("Indexed");
+			check(rfree(indexed[victim]));
+			rchoose("Scanned");
+			check(rfree(scanned[victim]));
+			live--;
+			indexed[victim] = indexed[live];
+			scanned[victim] = scanned[live];
+		}
+	}
+
+	rdestroy("Indexed");
+	rdestroy("Scanned");
+	check(rchosen() == NULL);
+}
+
+void test_numa_regions()
+{
+	rinit_options options = { NUMA_DEFAULT, 0, FIRST_FIT, false };
+	region_stats stats;
+	char * block;
+	unsigned int pages;
+	int i;
+
+	printf("\n====== Begin Testing NUMA Regions. ======\n");
+
+	printf("\nBind a region to node 0, which every machine has.\n");
+
+	options.numa = NUMA_BIND;
+	options.numa_node = 0;
+	check(rinit_ex("Bound", 20000, &options));
+	check(strcmp(rchosen(), "Bound") == 0);
+
+	for (i = 0; i < 10; i++)
+	{
+		block = ralloc(2000);
+		check(NULL != block);
+		check(rsize(block) == 2000);
+	}
+
+	check(rstats("Bound", &stats));
+	check(stats.size == 20000);
+	check(stats.bytes_used == 20000);
+	check(stats.block_count == 10);
+	check(NUMA_DEFAULT == stats.numa || (NUMA_BIND == stats.numa && 0 == stats.numa_node));
+
+	if (stats.residency_known)
+	{
+		pages = stats.absent_pages;
+
+		for (i = 0; i < RSTATS_NODES; i++)
+		{
+			pages += stats.node_pages[i];
+		}
+
+		check(pages * sysconf(_SC_PAGESIZE) >= 20000);
+		check(0 == stats.absent_pages);	// Zeroing the blocks touched every page
+
+		if (NUMA_BIND == stats.numa)
+		{
+			check(stats.node_pages[0] == pages);
+		}
+	}
+
+	printf("\nA node that does not exist falls back to the default policy.\n");
+
+	options.numa_node = RSTATS_NODES - 1;
+	check(rinit_ex("Nowhere", 4096, &options));
+	check(NULL != ralloc(4096));
+	check(rstats("Nowhere", &stats));
+	check(NUMA_DEFAULT == stats.numa || NUMA_BIND == stats.numa);
+
+	printf("\nInterleaved, local and plain regions.\n");
+
+	options.numa = NUMA_INTERLEAVE;
+	check(rinit_ex("Interleaved", 8192, &options));
+	check(NULL != ralloc(8192));
+	check(rstats("Interleaved", &stats));
+	check(stats.block_count == 1);
+
+	options.numa = NUMA_LOCAL;
+	check(rinit_ex("Local", 8192, &options));
+	check(rstats("Local", &stats));
+	check(NUMA_DEFAULT == stats.numa || (NUMA_LOCAL == stats.numa && 0 <= stats.numa_node));
+
+	check(rinit_ex("Plain", 100, NULL));
+	check(rstats("Plain", &stats));
+	check(NUMA_DEFAULT == stats.numa && stats.block_count == 0);
+	check(!rstats("Missing", &stats));
+
+	rdestroy("Bound");
+	rdestroy("Nowhere");
+	rdestroy("Interleaved");
+	rdestroy("Local");
+	rdestroy("Plain");
+	check(rchosen() == NULL);
 }
 
+void test_placement_policies()
+{
+	rinit_options options = { NUMA_DEFAULT, 0, NEXT_FIT };
+	char * blocks[6];
+	int i;
+
+	printf("\n====== Begin Testing Placement Policies. ======\n");
+
+	printf("\nNext fit carries on after the last block before wrapping around.\n");
+
+	check(rinit_ex("Next fit", 80, &options));
+
+	for (i = 0; i < 4; i++)
+	{
+		blocks[i] = ralloc(16);
+		check(NULL != blocks[i]);
+	}
+
+	check(rfree(blocks[0]));
+	check(ralloc(8) == blocks[3] + 16);
+	check(ralloc(8) == blocks[3] + 24);
+	check(ralloc(8) == blocks[0]);
+	check(ralloc(8) == blocks[0] + 8);
+	check(ralloc(8) == NULL);
+
+	rdestroy("Next fit");
+
+	printf("\nBest fit takes the smallest gap, the lowest one on ties.\n");
+
+	options.placement = BEST_FIT;
+	check(rinit_ex("Best fit", 100, &options));
+
+	for (i = 0; i < 6; i++)
+	{
+		blocks[i] = ralloc(i % 2 == 0 ? (i == 0 ? 24 : 16) : 8);
+		check(NULL != blocks[i]);
+	}
+
+	check(rfree(blocks[0]));
+	check(rfree(blocks[2]));
+	check(rfree(blocks[4]));
+
+	check(ralloc(16) == blocks[2]);
+	check(ralloc(16) == blocks[4]);
+	check(ralloc(8) == blocks[0]);
+	check(ralloc(24) == blocks[5] + 8);
+
+	rdestroy("Best fit");
+	check(rchosen() == NULL);
+}
+
+void test_tracing()
+{
+	const char * path = "regions_test.trace";
+	trace_op expected[] = { TRACE_INIT, TRACE_ALLOC, TRACE_ALLOC, TRACE_ALLOC,
+		TRACE_FREE, TRACE_DESTROY };
+	trace_record records[32];
+	char magic[sizeof(TRACE_MAGIC)];
+	char * blocks[3];
+	FILE * file;
+	int count = 0;
+	int inits;
+	int frees;
+	int i;
+	int j;
+
+	printf("\n====== Begin Testing Tracing. ======\n");
+
+	printf("\nTrace a short session and read it back.\n");
+
+	check(rtrace_start(path));
+	check(!rtrace_start(path));	// Already tracing
+
+	check(rinit("Traced", 64));
+	blocks[0] = ralloc(20);
+	blocks[1] = ralloc(8);
+	blocks[2] = ralloc(100);	// Too big, traced as a failure
+	check(NULL != blocks[0] && NULL != blocks[1] && NULL == blocks[2]);
+	check(rfree(blocks[1]));
+	check(!rfree(blocks[1]));	// Failed frees are not traced
+	rdestroy("Traced");
+
+	rtrace_stop();
+	check(rinit("Untraced", 64));
+	rdestroy("Untraced");
+
+	file = fopen(path, "rb");
+	check(NULL != file);
+
+	if (NULL != file)
+	{
+		check(sizeof(magic) == fread(magic, 1, sizeof(magic), file));
+		check(0 == memcmp(magic, TRACE_MAGIC, sizeof(magic)));
+		count = fread(records, sizeof(trace_record), 8, file);
+		fclose(file);
+	}
+
+	check(6 == count);
+
+	for (i = 0; i < count && i < 6; i++)
+	{
+		check(records[i].op == expected[i]);
+		check(records[i].sequence == (unsigned long long)i);
+		check(records[i].region == records[0].region);
+	}
+
+	if (6 == count)
+	{
+		check(records[0].size == 64);
+		check(records[1].size == 20 && records[1].offset == 0);
+		check(records[2].size == 8 && records[2].offset == 24);
+		check(records[3].size == 100 && records[3].offset == TRACE_NO_BLOCK);
+		check(records[4].offset == 24);
+	}
+
+	check(0 == remove(path));
+
+	printf("\nEvery kind of region traces its init, so its records can be replayed.\n");
+
+	check(rtrace_start(path));
+	check(rinit("Traced parent", 256));
+	check(NULL != ralloc(16));
+	check(rinit_child("Traced parent", "Traced child", 64));
+	blocks[0] = ralloc(8);
+	check(rinit_pool("Traced pool", 16, 4));
+	blocks[1] = ralloc(16);
+	check(rfree(blocks[1]));
+	check(rinit_frames("Traced frames", 32, 2));
+	blocks[2] = ralloc(8);
+	check(rframe_advance() && rframe_advance());
+	check(rchoose("Traced child") && rfree(blocks[0]));
+	rdestroy("Traced frames");
+	rdestroy("Traced pool");
+	rdestroy("Traced parent");
+	rtrace_stop();
+
+	count = 0;
+	file = fopen(path, "rb");
+	check(NULL != file);
+
+	if (NULL != file)
+	{
+		check(sizeof(magic) == fread(magic, 1, sizeof(magic), file));
+		count = fread(records, sizeof(trace_record), 32, file);
+		fclose(file);
+	}
+
+	inits = 0;
+	frees = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		for (j = 0; j < i && !(TRACE_INIT == records[j].op && records[j].region == records[i].region); j++);
+		check(TRACE_INIT == records[i].op || j < i);	// Every record follows its region's init
+		inits += TRACE_INIT == records[i].op;
+		frees += TRACE_FREE == records[i].op && 32 == records[i].size;
+	}
+
+	check(4 == inits);
+	check(2 == frees);	// One per frame emptied
+	check(0 == remove(path));
+}
+
+void test_region_handles()
+{
+	region_handle first;
+	region_handle second;
+	char * first_block;
+	char * second_block;
+
+	printf("\n====== Begin Testing Region Handles. ======\n");
+
+	printf("\nAllocate from two regions by handle, leaving the chosen region alone.\n");
+
+	check(rinit("First handle", 64));
+	check(rinit("Second handle", 64));
+	first = rhandle("First handle");
+	second = rhandle("Second handle");
+	check(NULL != first && NULL != second && first != second);
+	check(rhandle("No handle") == NULL);
+
+	first_block = ralloc_in(first, 20);
+	second_block = ralloc_in(second, 64);
+	check(NULL != first_block && NULL != second_block);
+	check(strcmp(rchosen(), "Second handle") == 0);
+
+	check(rsize_in(first, first_block) == 24);
+	check(rsize_in(first, second_block) == 0);	// Owned by the other region
+	check(rsize_in(second, second_block) == 64);
+	check(ralloc_in(second, 8) == NULL);
+
+	check(!rfree_in(second, first_block));
+	check(rfree_in(first, first_block));
+	check(!rfree_in(first, first_block));
+	check(rfree(second_block));
+	check(rsize_in(second, second_block) == 0);
+
+	rdestroy("First handle");
+	rdestroy("Second handle");
+	check(rchosen() == NULL);
+}
+
+void test_profiler()
+{
+	const char * path = "regions_test.profile";
+	char line[4096];
+	char * blocks[100];
+	char * value;
+	FILE * file;
+	long live = 0;
+	long total = 0;
+	int lines = 0;
+	int i;
+
+	printf("\n====== Begin Testing Profiler. ======\n");
+
+	printf("\nSample every block and check the dumps add up.\n");
+
+	check(rprofile_start(1));
+	check(rinit("Profiled", 4096));
+
+	for (i = 0; i < 100; i++)
+	{
+		blocks[i] = ralloc(i < 50 ? 16 : 32);
+		check(NULL != blocks[i]);
+	}
+
+	for (i = 0; i < 25; i++)
+	{
+		check(rfree(blocks[i]));
+	}
+
+	check(rprofile_dump(path, RPROFILE_LIVE));
+	file = fopen(path, "r");
+	check(NULL != file);
+
+	while (NULL != file && NULL != fgets(line, sizeof(line), file))
+	{
+		check(strncmp(line, "region:Profiled;", 16) == 0);
+		value = strrchr(line, ' ');
+		live += NULL != value ? atol(value) : 0;
+		lines++;
+	}
+
+	if (NULL != file)
+	{
+		fclose(file);
+	}
+
+	check(0 < lines);
+	check(live == 25 * 16 + 50 * 32);
+
+	check(rprofile_dump(path, RPROFILE_CUMULATIVE));
+	file = fopen(path, "r");
+	check(NULL != file);
+
+	while (NULL != file && NULL != fgets(line, sizeof(line), file))
+	{
+		value = strrchr(line, ' ');
+		total += NULL != value ? atol(value) : 0;
+	}
+
+	if (NULL != file)
+	{
+		fclose(file);
+	}
+
+	check(total == 50 * 16 + 50 * 32);
+
+	printf("\nDestroying the region drops its live bytes.\n");
+
+	rdestroy("Profiled");
+	rprofile_stop();
+	check(rinit("Unprofiled", 64));
+	check(NULL != ralloc(8));
+	rdestroy("Unprofiled");
+
+	check(rprofile_dump(path, RPROFILE_LIVE));
+	file = fopen(path, "r");
+	check(NULL != file && NULL == fgets(line, sizeof(line), file));
+
+	if (NULL != file)
+	{
+		fclose(file);
+	}
+
+	check(0 == remove(path));
+}
+
+void test_scratch_marks()
+{
+	region_mark outer;
+	region_mark inner;
+	region_stats stats;
+	char * first;
+	char * second;
+	char * third;
+	char * fourth;
+
+	printf("\n====== Begin Testing Scratch Marks. ======\n");
+
+	printf("\nRelease nested marks, newest first.\n");
+
+	check(rinit("Scratch", 256));
+	first = ralloc(32);
+	outer = rmark();
+	check(outer.region == rhandle("Scratch"));
+
+	second = ralloc(32);
+	check(rfree(first));
+	third = ralloc(16);	// Lands in front of second, in the gap first left
+	check(third < second);
+
+	inner = rmark();
+	fourth = ralloc(64);
+	check(NULL != second && NULL != third && NULL != fourth);
+
+	check(rrelease(inner));
+	check(rsize(fourth) == 0);
+	check(rsize(second) == 32 && rsize(third) == 16);
+	check(rstats("Scratch", &stats) && stats.bytes_used == 48 && stats.block_count == 2);
+
+	check(rrelease(outer));
+	check(rsize(second) == 0 && rsize(third) == 0);
+	check(rstats("Scratch", &stats) && stats.bytes_used == 0 && stats.block_count == 0);
+
+	printf("\nThe released space can be allocated again.\n");
+
+	check(NULL != ralloc(256));
+	check(rrelease(outer));
+	check(NULL != ralloc(128));
+	check(rrelease(outer));	// Releasing to the same mark again is allowed
+	check(rstats("Scratch", &stats) && stats.block_count == 0);
+
+	rdestroy("Scratch");
+
+	printf("\nReleasing a mark destroys the children made after it.\n");
+
+	check(rinit("Scratch parent", 4096));
+	first = ralloc(64);
+	check(rinit_child("Scratch parent", "Scratch elder", 256));
+	check(rchoose("Scratch parent"));
+	outer = rmark();
+	check(rinit_child("Scratch parent", "Scratch child", 1024));
+	check(rinit_child("Scratch child", "Scratch grandchild", 256));
+	check(rchoose("Scratch parent"));
+	check(rrelease(outer));
+	check(NULL == rhandle("Scratch child") && NULL == rhandle("Scratch grandchild"));
+	check(NULL != rhandle("Scratch elder"));
+	check(rstats("Scratch parent", &stats) && stats.bytes_used == 320 && stats.block_count == 2);
+	second = ralloc(1024);
+	check(second == first + 320);
+	rdestroy("Scratch elder");
+	check(rstats("Scratch parent", &stats) && stats.bytes_used == 1088);
+	rdestroy("Scratch parent");
+
+	printf("\nPool regions cannot be marked.\n");
+
+	check(rinit_pool("Scratch pool", 16, 4));
+	check(rmark().region == NULL);
+	rdestroy("Scratch pool");
+}
+
+void test_frame_regions()
+{
+	region_stats stats;
+	char * base;
+	char * first;
+	char * second;
+	char * third;
+	int i;
+
+	printf("\n====== Begin Testing Frame Regions. ======\n");
+
+	printf("\nBump allocate in the first of two frames.\n");
+
+	check(!rinit_frames("Too many frames", 1024, 100));
+	check(rinit_frames("Frames", 100, 2));
+	base = rbase();
+	check(rstats("Frames", &stats) && stats.size == 208);
+
+	first = ralloc(10);
+	second = ralloc(20);
+	check(first == base && second == base + 16);
+	check(NULL != ralloc(64));
+	check(NULL == ralloc(16));	// The current frame is full
+	check(rsize(first) == 0);	// Frame blocks have no size of their own
+	check(!rfree(first));
+
+	printf("\nBlocks survive one advance and go on the next.\n");
+
+	check(rframe_advance());
+	third = ralloc(8);
+	check(third == base + 104);
+	check(*third == 0);
+	third[0] = 'x';
+	check(rstats("Frames", &stats) && stats.bytes_used == 112 && stats.block_count == 4);
+
+	check(rframe_advance());
+	check(ralloc(8) == base);	// The first frame was emptied
+	check(rstats("Frames", &stats) && stats.bytes_used == 16 && stats.block_count == 2);
+
+	check(rframe_advance());
+	check(ralloc(8) == third);
+	check(*third == 0);
+
+	for (i = 0; i < 100; i++)
+	{
+		check(rframe_advance());
+	}
+
+	check(rstats("Frames", &stats) && stats.bytes_used == 0 && stats.block_count == 0);
+
+	printf("\nFrame regions cannot hold children.\n");
+
+	check(!rinit_child("Frames", "Frame child", 16));
+	check(strcmp(rchosen(), "Frames") == 0);
+
+	rdestroy("Frames");
+	check(rchosen() == NULL);
+}
+
+void test_strings()
+{
+	region_buffer buffer;
+	region_stats stats;
+	char * text;
+	char * block;
+	char * moved;
+	char * start;
+	int i;
+
+	printf("\n====== Begin Testing Strings and Buffers. ======\n");
+
+	printf("\nCopy and format strings into the chosen region.\n");
+
+	check(rinit("Strings", 1024));
+
+	text = rstrdup("hello");
+	check(NULL != text && strcmp(text, "hello") == 0 && rsize(text) == 8);
+	text = rstrndup("hello world", 5);
+	check(NULL != text && strcmp(text, "hello") == 0);
+	text = rstrndup("hi", 10);
+	check(NULL != text && strcmp(text, "hi") == 0);
+
+	text = rprintf("%s-%d", "tick", 42);
+	check(NULL != text && strcmp(text, "tick-42") == 0 && rsize(text) == 8);
+	text = rprintf("%0100d", 7);	// Longer than the first try
+	check(NULL != text && strlen(text) == 100 && text[99] == '7' && rsize(text) == 104);
+
+	rdestroy("Strings");
+
+	printf("\nGrow a block in place, then move it when it is boxed in.\n");
+
+	check(rinit("Resizing", 256));
+	block = ralloc(16);
+	memset(block, 'a', 16);
+	check(rrealloc(block, 40) == block);
+	check(rsize(block) == 40 && block[15] == 'a' && block[16] == 0 && block[39] == 0);
+
+	check(NULL != ralloc(8));
+	moved = rrealloc(block, 64);
+	check(NULL != moved && moved != block && moved[0] == 'a' && moved[15] == 'a');
+	check(rsize(block) == 0 && rsize(moved) == 64);
+
+	check(rrealloc(moved, 8) == moved && rsize(moved) == 8);
+	check(rstats("Resizing", &stats) && stats.bytes_used == 16 && stats.block_count == 2);
+	check(NULL == rrealloc(moved, 256));	// Too big anywhere
+	check(rsize(moved) == 8 && moved[0] == 'a');
+
+	rdestroy("Resizing");
+
+	printf("\nAppend to a buffer that grows in place.\n");
+
+	check(rinit("Buffers", 4096));
+	check(rbuf_init(&buffer, 8));
+	start = buffer.data;
+
+	for (i = 0; i < 100; i++)
+	{
+		check(rbuf_append(&buffer, "ab", 2));
+	}
+
+	check(rbuf_printf(&buffer, "[%d]", 12345));
+	check(buffer.data == start);
+	check(buffer.length == 207 && strlen(buffer.data) == 207);
+	check(strncmp(buffer.data + 198, "ab[12345]", 9) == 0);
+	check(!rbuf_append(&buffer, buffer.data, 4000));	// No room left
+	check(buffer.length == 207 && strlen(buffer.data) == 207);
+
+	text = rbuf_finish(&buffer);
+	check(text == start && rsize(text) == 208 && NULL == buffer.data);
+	check(rfree(text));
+
+	check(rbuf_init(&buffer, 0));
+	check(rbuf_printf(&buffer, "%s", ""));
+	check(buffer.length == 0 && buffer.data[0] == '\0');
+	rbuf_free(&buffer);
+	check(rstats("Buffers", &stats) && stats.bytes_used == 0);
+
+	rdestroy("Buffers");
+}
+
+void test_containers()
+{
+	region_vector vector;
+	region_map map;
+	region_deque deque;
+	region_stats stats;
+	void * value;
+	char * start;
+	int element;
+	int i;
+
+	printf("\n====== Begin Testing Containers. ======\n");
+
+	printf("\nPush onto a vector that grows in place.\n");
+
+	check(rinit("Containers", -1));
+	check(rvec_init(&vector, sizeof(int), 0));
+	start = vector.data;
+
+	for (i = 0; i < 1000; i++)
+	{
+		check(rvec_push(&vector, &i));
+	}
+
+	check(vector.data == start && vector.count == 1000 && vector.capacity == 1024);
+	check(*(int *)rvec_at(&vector, 0) == 0 && *(int *)rvec_at(&vector, 999) == 999);
+	check(NULL == rvec_at(&vector, 1000));
+	check(rvec_pop(&vector, &element) && element == 999 && vector.count == 999);
+
+	printf("\nFill, update and empty a growing map.\n");
+
+	check(rmap_init(&map, 0));
+
+	for (i = 0; i < 500; i++)
+	{
+		check(rmap_put(&map, i * 7919ULL, (void *)(long)i));
+	}
+
+	check(map.count == 500 && map.capacity == 1024);
+	check(rmap_get(&map, 499 * 7919ULL, &value) && (long)value == 499);
+	check(!rmap_get(&map, 1, &value));
+	check(rmap_put(&map, 0, (void *)-1L) && map.count == 500);
+	check(rmap_get(&map, 0, &value) && (long)value == -1);
+
+	for (i = 0; i < 500; i += 2)
+	{
+		check(rmap_remove(&map, i * 7919ULL));
+	}
+
+	check(!rmap_remove(&map, 0) && map.count == 250);
+	check(!rmap_get(&map, 498 * 7919ULL, NULL) && rmap_get(&map, 497 * 7919ULL, NULL));
+
+	for (i = 0; i < 250; i++)	// Reuses the deleted slots
+	{
+		check(rmap_put(&map, (1ULL << 40) + i, NULL));
+	}
+
+	check(map.count == 500 && map.capacity == 1024);
+	rmap_free(&map);
+
+	printf("\nA map given its capacity up front holds three quarters of it.\n");
+
+	check(rmap_init(&map, 2048) && map.capacity == 2048);
+
+	for (i = 0; i < 1536; i++)
+	{
+		check(rmap_put(&map, i, NULL));
+	}
+
+	check(!rmap_put(&map, 1536, NULL));
+	check(rmap_put(&map, 1535, &map));	// Updates still work
+	check(rmap_get(&map, 1535, &value) && value == &map);
+	rmap_free(&map);
+
+	printf("\nPush and pop both ends of a deque that wraps as it grows.\n");
+
+	check(rdeque_init(&deque, sizeof(int), 4));
+
+	for (i = 0; i < 3; i++)
+	{
+		check(rdeque_push_back(&deque, &i));
+	}
+
+	check(rdeque_pop_front(&deque, &element) && element == 0);
+
+	for (i = 3; i < 10; i++)
+	{
+		check(rdeque_push_back(&deque, &i));
+	}
+
+	element = -1;
+	check(rdeque_push_front(&deque, &element));
+	check(deque.count == 10 && deque.capacity == 16);
+
+	for (i = 0; i < 10; i++)
+	{
+		check(*(int *)rdeque_at(&deque, i) == i - 1 + (0 < i));
+	}
+
+	check(rdeque_pop_back(&deque, &element) && element == 9);
+	check(rdeque_pop_front(&deque, &element) && element == -1);
+	check(rdeque_pop_front(&deque, &element) && element == 1);
+	check(NULL == rdeque_at(&deque, 7));
+
+	printf("\nDestroying the region takes the containers with it.\n");
+
+	check(rstats("Containers", &stats) && stats.block_count == 2);
+	rdestroy("Containers");
+	check(rchosen() == NULL);
+}
+
+void test_fixed_sizes()
+{
+	region_handle region;
+	char * block;
+	rsize_t size = 13;
+
+	printf("\n====== Begin Testing Fixed Sizes. ======\n");
+
+	printf("\nRound constant sizes at compile time in each kind of region.\n");
+
+	check(RROUNDED(1) == 8 && RROUNDED(8) == 8 && RROUNDED(65521) == 65528);
+
+	check(rinit_pool("Fixed pool", 32, 4));
+	region = rhandle("Fixed pool");
+	block = RALLOC_FIXED(region, 20);
+	check(NULL != block && block == rbase() && rsize(block) == 32);
+	check(NULL == RALLOC_FIXED(region, 40));	// Bigger than the objects
+	size = 65530;
+	check(NULL == ralloc_fixed_in(region, size));	// Would round past rsize_t
+	size = 0;
+	check(NULL == ralloc_fixed_in(region, size));
+	size = 13;
+	check(rfree(block));
+	rdestroy("Fixed pool");
+
+	check(rinit_frames("Fixed frames", 64, 2));
+	region = rhandle("Fixed frames");
+	check(RALLOC_FIXED(region, 12) == rbase());
+	check(RALLOC_FIXED(region, 1) == (char *)rbase() + 16);
+	rdestroy("Fixed frames");
+
+	check(rinit("Fixed heap", 64));
+	region = rhandle("Fixed heap");
+	block = RALLOC_FIXED(region, 1);
+	check(NULL != block && rsize(block) == 8);
+	block = ralloc_fixed_in(region, size);	// Rounded inline at run time
+	check(NULL != block && rsize(block) == 16 && block[15] == 0);
+	check(NULL == RALLOC_FIXED(region, 48));
+	rdestroy("Fixed heap");
+}
+
+void test_offset_pointers()
+{
+	typedef struct
+	{
+		roff16 next;
+		unsigned short value;
+	} small_node;
+
+	region_handle region;
+	small_node * node;
+	small_node * head = NULL;
+	char * copy;
+	void * base;
+	int count = 0;
+	int sum = 0;
+	int i;
+
+	printf("\n====== Begin Testing Offset Pointers. ======\n");
+
+	printf("\nLink a list with 16 bit offsets and walk a copy of it.\n");
+
+	check(sizeof(small_node) == 4);
+	check(rinit("Offsets", 1024));
+	region = rhandle("Offsets");
+	base = rbase_in(region);
+	check(base == rbase());
+
+	for (i = 1; i <= 100; i++)
+	{
+		node = ralloc(sizeof(small_node));
+		node->value = i;
+		node->next = roff16_encode(base, head);
+		head = node;
+	}
+
+	check(roff16_encode(base, NULL) == 0 && roff16_decode(base, 0) == NULL);
+	check(roff16_decode(base, roff16_encode(base, head)) == head);
+
+	copy = malloc(1024);
+	memcpy(copy, base, 1024);
+
+	for (node = (small_node *)(copy + ((char *)head - (char *)base)); NULL != node;
+			node = roff16_decode(copy, node->next))
+	{
+		sum += node->value;
+		count++;
+	}
+
+	check(count == 100 && sum == 5050);
+	free(copy);
+
+	printf("\nChecked offsets stay inside the region.\n");
+
+	check(roff_encode_in(region, head) == roff32_encode(base, head));
+	check(roff_decode_in(region, roff32_encode(base, head)) == head);
+	check(roff_encode_in(region, NULL) == 0);
+	check(roff_encode_in(region, (char *)base + 1024) == 0);	// Just past the end
+	check(roff_encode_in(region, &count) == 0);
+	check(roff_decode_in(region, 1024) == (char *)base + 1023);
+	check(roff_decode_in(region, 1025) == NULL);
+	check(roff_decode_in(region, 0) == NULL);
+
+	rdestroy("Offsets");
+}
+
+void test_region_clones()
+{
+	rinit_options options = { NUMA_DEFAULT, 0, FIRST_FIT, true };
+	region_stats source_stats;
+	region_stats clone_stats;
+	char * template_base;
+	char * template_block;
+	char * spare_block;
+	char * clone_block;
+	roff32 link;
+	void * block;
+
+	printf("\n====== Begin Testing Region Clones. ======\n");
+
+	printf("\nBuild a cloneable template region.\n");
+
+	check(rinit_ex("Template", 30000, &options));
+	template_base = rbase();
+	template_block = ralloc(104);
+	spare_block = ralloc(200);
+	check(NULL != template_block && NULL != spare_block);
+	strcpy(template_block, "template");
+	link = roff32_encode(template_base, spare_block);
+	memcpy(template_block + 50, &link, sizeof(link));
+	check(rfree(ralloc(8)));
+	check(NULL != ralloc(300));
+
+	printf("\nClone it, which chooses the clone.\n");
+
+	check(rclone("Template", "Copy"));
+	check(strcmp(rchosen(), "Copy") == 0);
+	check(NULL != rbase());
+	check(template_base != rbase());
+
+	printf("\nThe clone has the same blocks at the same offsets.\n");
+
+	clone_block = (char *)rbase() + (template_block - template_base);
+	check(strcmp(clone_block, "template") == 0);
+	check(rsize(clone_block) == 104);
+	memcpy(&link, clone_block + 50, sizeof(link));
+	check(roff32_decode(rbase(), link) == (char *)rbase() + (spare_block - template_base));
+	check(rsize(roff32_decode(rbase(), link)) == 200);
+	check(rstats("Template", &source_stats));
+	check(rstats("Copy", &clone_stats));
+	check(source_stats.bytes_used == clone_stats.bytes_used);
+	check(source_stats.block_count == clone_stats.block_count);
+
+	printf("\nWrites to the clone are its own.\n");
+
+	strcpy(clone_block, "changed");
+	check(strcmp(template_block, "template") == 0);
+	block = ralloc(1000);
+	check(NULL != block);
+	check(rfree(clone_block));
+	check(rsize_in(rhandle("Template"), template_block) == 104);
+	check(rstats("Template", &source_stats));
+	check(rstats("Copy", &clone_stats));
+	check(source_stats.bytes_used + 1000 - 104 == clone_stats.bytes_used);
+
+	printf("\nThe clone outlives its template.\n");
+
+	rdestroy("Template");
+	check(rchoose("Copy"));
+	check(rsize(block) == 1000);
+	rdestroy("Copy");
+
+	printf("\nA region that is not cloneable is copied.\n");
+
+	check(rinit("Plain", 1000));
+	template_block = ralloc(40);
+	strcpy(template_block, "plain");
+	check(rclone("Plain", "Plain copy"));
+	check(strcmp((char *)rbase(), "plain") == 0);
+	check(rsize(rbase()) == 40);
+	rdestroy("Plain");
+	rdestroy("Plain copy");
+
+	printf("\nPools and unknown regions cannot be cloned.\n");
+
+	check(rinit_pool("Clone pool", 16, 4));
+	check(!rclone("Clone pool", "Pool copy"));
+	check(!rclone("Missing", "Missing copy"));
+	rdestroy("Clone pool");
+	check(NULL == rchosen());
+}
+
+void test_prefaulting()
+{
+	rinit_options options = { NUMA_DEFAULT, 0, FIRST_FIT, false, PREFAULT_NOW };
+	region_stats stats;
+	char * block;
+	int i;
+
+	printf("\n====== Begin Testing Prefaulting. ======\n");
+
+	printf("\nPrefault a region before rinit_ex returns.\n");
+
+	check(rinit_ex("Warm", 60000, &options));
+	check(rready("Warm"));
+	check(rstats("Warm", &stats));
+	check(!stats.residency_known || 0 == stats.absent_pages);
+	rdestroy("Warm");
+
+	printf("\nWarm regions on helper threads while using one of them.\n");
+
+	options.prefault = PREFAULT_ASYNC;
+	check(rinit_ex("Warming 1", 60000, &options));
+	options.numa = NUMA_INTERLEAVE;
+	check(rinit_ex("Warming 2", 60000, &options));
+	check(rinit_ex("Warming 3", 60000, &options));
+	check(rchoose("Warming 1"));
+	block = ralloc(40000);
+	check(NULL != block);
+
+	for (i = 0; NULL != block && i < 40000; i++)
+	{
+		block[i] = (char)i;
+	}
+
+	check(rwait_ready("Warming 1"));
+	check(rwait_ready("Warming 2"));
+	check(rready("Warming 1") && rready("Warming 2"));
+	check(rstats("Warming 2", &stats));
+	check(!stats.residency_known || 0 == stats.absent_pages);
+
+	for (i = 0; NULL != block && i < 40000 && block[i] == (char)i; i++);
+	check(40000 == i);
+
+	printf("\nDestroying a region waits for its warming.\n");
+
+	rdestroy("Warming 3");
+	rdestroy("Warming 2");
+	rdestroy("Warming 1");
+	check(!rready("Warming 1"));
+	check(!rwait_ready("Warming 1"));
+
+	printf("\nRegions without prefaulting are always ready.\n");
+
+	check(rinit("Cold", 100));
+	check(rready("Cold"));
+	rdestroy("Cold");
+}
+
+void test_large_objects()
+{
+	rinit_options options = { NUMA_DEFAULT, 0, FIRST_FIT, false, PREFAULT_NONE, 1024 };
+	region_stats stats;
+	char * small[4];
+	char * big;
+	char * moved;
+	char * data;
+	int i;
+
+	printf("\n====== Begin Testing Large Objects. ======\n");
+
+	printf("\nA block over the threshold gets its own mapping, even past the region size.\n");
+
+	check(rinit_ex("Mixed", 4096, &options));
+	data = rbase();
+	big = ralloc(60000);
+	check(NULL != big);
+	check(big < data || big >= data + 4096);
+	check(0 == (unsigned long)big % 4096);
+	check(rsize(big) == 60000);
+
+	for (i = 0; NULL != big && i < 60000 && 0 == big[i]; i++);
+	check(60000 == i);
+	memset(big, 'x', 60000);
+
+	printf("\nSmall blocks still fill the region densely.\n");
+
+	for (i = 0; i < 4; i++)
+	{
+		small[i] = ralloc(1000);
+		check(small[i] == data + i * 1000);
+	}
+
+	check(rstats("Mixed", &stats));
+	check(4000 == stats.bytes_used);
+	check(5 == stats.block_count);
+	check(60000 == stats.large_bytes);
+
+	printf("\nResize a large object, then shrink it back into the region.\n");
+
+	big = rrealloc(big, 30000);
+	check(NULL != big && rsize(big) == 30000 && 'x' == big[29999]);
+	check(rfree(small[3]));
+	moved = rrealloc(big, 500);
+	check(moved == data + 3000);
+	check(NULL != moved && 'x' == moved[0] && 'x' == moved[499]);
+	check(!rfree(big));
+	check(rstats("Mixed", &stats));
+	check(0 == stats.large_bytes);
+
+	printf("\nGrowing the last block past the threshold moves it to a mapping.\n");
+
+	big = rrealloc(moved, 1096);
+	check(NULL != big && (big < data || big >= data + 4096));
+	check(NULL != big && 'x' == big[0] && 'x' == big[499] && rsize(big) == 1096);
+	check(rstats("Mixed", &stats));
+	check(1096 == stats.large_bytes && 3000 == stats.bytes_used);
+	check(rfree(big));
+
+	printf("\nrfree unmaps a large object and rdestroy takes the rest.\n");
+
+	big = ralloc(5000);
+	check(NULL != big);
+	check(rfree(big));
+	check(0 == rsize(big));
+	check(NULL != ralloc(20000));
+	check(NULL != ralloc(40000));
+	check(rstats("Mixed", &stats));
+	check(60000 == stats.large_bytes);
+	rdestroy("Mixed");
+
+	printf("\nRegions without a threshold refuse oversized blocks as before.\n");
+
+	check(rinit("Unmixed", 4096));
+	check(NULL == ralloc(5000));
+	rdestroy("Unmixed");
+}
+
+typedef struct
+{
+	unsigned int blocks;
+	unsigned int bytes;
+	unsigned int limit;
+	char * low;
+	char * high;
+} walk_totals;
+
+boolean count_block(void * block, rsize_t size, void * context)
+{
+	walk_totals * totals = context;
+	boolean in_range = (char *)block >= totals->low && (char *)block + size <= totals->high;
+
+	__atomic_fetch_add(&totals->blocks, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&totals->bytes, size, __ATOMIC_RELAXED);
+
+	return in_range && __atomic_load_n(&totals->blocks, __ATOMIC_RELAXED) < totals->limit;
+}
+
+void test_block_walks()
+{
+	rinit_options options = { NUMA_DEFAULT, 0, FIRST_FIT, false, PREFAULT_NONE, 4096 };
+	walk_totals totals = { 0, 0, 100000, NULL, NULL };
+	region_stats stats;
+	void * blocks[3000];
+	char * big;
+	int i;
+
+	printf("\n====== Begin Testing Block Walks. ======\n");
+
+	printf("\nVisit every live block of a region with thousands of blocks.\n");
+
+	check(rinit_ex("Walked", 60000, &options));
+	totals.low = rbase();
+	totals.high = totals.low + 60000;
+
+	for (i = 0; i < 3000; i++)
+	{
+		blocks[i] = ralloc(8 + i % 3 * 8);
+	}
+
+	for (i = 0; i < 3000; i += 7)
+	{
+		check(rfree(blocks[i]));
+	}
+
+	check(rforeach_block("Walked", count_block, &totals));
+	check(rstats("Walked", &stats));
+	check(totals.blocks == stats.block_count);
+	check(totals.bytes == stats.bytes_used);
+
+	printf("\nSplit the walk over worker threads.\n");
+
+	totals.blocks = 0;
+	totals.bytes = 0;
+	check(rforeach_block_parallel("Walked", count_block, &totals, 4));
+	check(totals.blocks == stats.block_count);
+	check(totals.bytes == stats.bytes_used);
+
+	totals.blocks = 0;
+	totals.bytes = 0;
+	check(rforeach_block_parallel("Walked", count_block, &totals, 1000));
+	check(totals.blocks == stats.block_count);
+
+	printf("\nA visitor stops the walk by returning false.\n");
+
+	totals.blocks = 0;
+	totals.limit = 10;
+	check(!rforeach_block("Walked", count_block, &totals));
+	check(10 == totals.blocks);
+
+	totals.blocks = 0;
+	check(!rforeach_block_parallel("Walked", count_block, &totals, 4));
+	check(10 <= totals.blocks && totals.blocks < stats.block_count);
+
+	printf("\nLarge objects are visited too.\n");
+
+	big = ralloc(10000);
+	check(NULL != big);
+	totals.blocks = 0;
+	totals.bytes = 0;
+	totals.limit = 100000;
+	check(!rforeach_block("Walked", count_block, &totals));	// big is outside the region
+	check(totals.blocks == stats.block_count + 1);
+	check(totals.bytes == stats.bytes_used + 10000u);
+	rdestroy("Walked");
+
+	printf("\nWalk a pool's objects; frame regions cannot be walked.\n");
+
+	check(rinit_pool("Walked pool", 32, 10));
+	totals.low = rbase();
+	totals.high = totals.low + 320;
+	check(NULL != ralloc(32) && NULL != ralloc(32) && NULL != ralloc(32));
+	totals.blocks = 0;
+	totals.bytes = 0;
+	check(rforeach_block("Walked pool", count_block, &totals));
+	check(3 == totals.blocks && 96 == totals.bytes);
+	rdestroy("Walked pool");
+
+	check(rinit_frames("Walked frames", 1024, 2));
+	check(NULL != ralloc(64));
+	check(!rforeach_block("Walked frames", count_block, &totals));
+	check(!rforeach_block("Missing", count_block, &totals));
+	rdestroy("Walked frames");
+}
+
+void test_bulk_operations()
+{
+	region_stats stats[8];
+	const char * names[8];
+	int i;
+
+	printf("\n====== Begin Testing Bulk Operations. ======\n");
+
+	printf("\nGive a tenant a few regions, one of them a child of a shared parent.\n");
+
+	check(rinit("Shared parent", 4000));
+	check(rinit_child("Shared parent", "tenant1/child", 1000));
+	check(NULL != ralloc(100));
+	check(rinit("tenant1/heap", 2000));
+	check(NULL != ralloc(500) && NULL != ralloc(500));
+	check(rinit_child("tenant1/heap", "Nested", 992));
+	check(NULL != ralloc(8));
+	check(rinit_pool("tenant1/pool", 16, 8));
+	check(NULL != ralloc(16));
+	check(rinit("tenant2/heap", 100));
+	check(NULL != ralloc(40));
+
+	printf("\nCollect stats for the tenant, including regions below its own.\n");
+
+	check(4 == rstats_matching("tenant1/", stats, names, 8));
+
+	for (i = 0; i < 4; i++)
+	{
+		check(strncmp(names[i], "tenant1/", 8) == 0 || strcmp(names[i], "Nested") == 0);
+		check(0 < stats[i].bytes_used);
+	}
+
+	check(4 == rstats_matching("tenant1/", stats, NULL, 2));
+	check(0 == rstats_matching("tenant3/", stats, names, 8));
+
+	printf("\nReset the tenant; the region nested in one of its blocks goes.\n");
+
+	check(3 == rreset_matching("tenant1/"));
+	check(!rchoose("Nested"));
+	check(3 == rstats_matching("tenant1/", stats, names, 8));
+
+	for (i = 0; i < 3; i++)
+	{
+		check(0 == stats[i].bytes_used && 0 == stats[i].block_count);
+	}
+
+	check(rchoose("tenant1/heap"));
+	check(NULL != ralloc(2000));
+	check(rchoose("tenant1/pool"));
+
+	for (i = 0; i < 8; i++)
+	{
+		check(NULL != ralloc(16));
+	}
+
+	printf("\nDestroy the tenant, returning its child's block to the parent.\n");
+
+	check(3 == rdestroy_matching("tenant1/"));
+	check(NULL == rchosen());
+	check(!rchoose("tenant1/heap") && !rchoose("tenant1/pool") && !rchoose("tenant1/child"));
+	check(1 == rstats_matching("Shared parent", stats, NULL, 8));
+	check(0 == stats[0].bytes_used);
+	check(1 == rstats_matching("tenant2/", stats, NULL, 8));
+	check(0 == rdestroy_matching("tenant1/"));
+
+	rdestroy("Shared parent");
+	check(1 == rdestroy_matching("tenant2/"));
+}
+
+int free_remaining_blocks(void * blocks[])
+{
+	int i = 0;
+	int success = 1;
+
+	while (NULL != blocks[i++])
+	{
+		if (rsize(blocks[i - 1]) > 0)
+		{
+			check(rfree(blocks[i - 1]));
+		}
+
+		if (rsize(blocks[i - 1]) != 0)
+		{
+			success = 0;
+		}
+	}
+
+	return success;
+}
+
+void print_results()
+{
+	printf("\nTests Failed: %d\n", tests_failed);
+}
@@ -0,0 +1,149 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "globals.h"
+
+#define NODE_MASK_BITS (8 * sizeof(unsigned long))
+
+boolean allowed_nodes(unsigned long * node_mask);
+boolean current_node(int * node);
+
+/* Sets the policy for a page aligned range before anything touches it.
+ * NUMA_LOCAL binds to the node the calling thread runs on now, which is
+ * looked up here, not at fault time. On return *node holds the node used,
+ * or -1 for interleaving. */
+
+boolean apply_numa_policy(void * start, size_t length, numa_policy policy, int * node)
+{
+	assert(NULL != start);
+	assert(NULL != node);
+
+	boolean success = false;
+	unsigned long allowed = 0;
+	unsigned long node_mask = 0;
+	int mode = MPOL_DEFAULT;
+
+	if (NULL != start && NULL != node && allowed_nodes(&allowed))
+	{
+		if (NUMA_LOCAL == policy && current_node(node))
+		{
+			policy = NUMA_BIND;
+		}
+
+		if (NUMA_BIND == policy && 0 <= *node && *node < (int)NODE_MASK_BITS)
+		{
+			mode = MPOL_BIND;
+			node_mask = allowed & (1UL << *node);
+		}
+		else if (NUMA_INTERLEAVE == policy)
+		{
+			mode = MPOL_INTERLEAVE;
+			node_mask = allowed;
+			*node = -1;
+		}
+
+		success = 0 != node_mask && 0 == syscall(SYS_mbind, start, length, mode,
+				&node_mask, NODE_MASK_BITS + 1, 0);
+	}
+
+	return success;
+}
+
+/* Counts the pages of a range per node. Pages not yet faulted in are
+ * counted as absent. */
+
+boolean numa_residency(void * start, size_t length, unsigned int node_pages[],
+		unsigned int * absent_pages)
+{
+	assert(NULL != start);
+	assert(NULL != node_pages);
+	assert(NULL != absent_pages);
+
+	boolean success = false;
+	uintptr_t page_size = sysconf(_SC_PAGESIZE);
+	uintptr_t first_page = (uintptr_t)start & ~(page_size - 1);
+	unsigned long page_count = ((uintptr_t)start + length - first_page + page_size - 1)
+		/ page_size;
+	void ** pages = NULL;
+	int * status = NULL;
+	unsigned long i;
+
+	memset(node_pages, 0, RSTATS_NODES * sizeof(unsigned int));
+	*absent_pages = 0;
+
+	if (NULL != start && 0 < length)
+	{
+		pages = malloc(page_count * sizeof(void *));
+		status = malloc(page_count * sizeof(int));
+	}
+
+	if (NULL != pages && NULL != status)
+	{
+		for (i = 0; i < page_count; i++)
+		{
+			pages[i] = (void *)(first_page + i * page_size);
+		}
+
+		success = 0 == syscall(SYS_move_pages, 0, page_count, pages, NULL, status, 0);
+
+		for (i = 0; success && i < page_count; i++)
+		{
+			if (0 <= status[i] && status[i] < RSTATS_NODES)
+			{
+				node_pages[status[i]]++;
+			}
+			else
+			{
+				(*absent_pages)++;
+			}
+		}
+	}
+
+	free(pages);
+	free(status);
+
+	return success;
+}
+
+boolean allowed_nodes(unsigned long * node_mask)
+{
+	*node_mask = 0;
+
+	return 0 == syscall(SYS_get_mempolicy, NULL, node_mask, NODE_MASK_BITS + 1,
+			NULL, MPOL_F_MEMS_ALLOWED) && 0 != *node_mask;
+}
+
+boolean current_node(int * node)
+{
+	unsigned int cpu;
+	unsigned int cpu_node;
+	boolean success = false;
+
+	success = 0 == syscall(SYS_getcpu, &cpu, &cpu_node, NULL);
+
+	if (success)
+	{
+		*node = cpu_node;
+	}
+
+	return success;
+}
@@ -0,0 +1,16 @@
+#include "regions.c"
+#include "region_list.c"
+#include "block_table.c"
+#include "gap_index.c"
+#include "pool.c"
+#include "frame.c"
+#include "large.c"
+#include "numa.c"
+#include "backing.c"
+#include "reclaimer.c"
+#include "prefault.c"
+#include "trace.c"
+#include "profiler.c"
+#include "rstring.c"
+#include "containers.c"
+#include "walk.c"
@@ -0,0 +1,162 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+
+#include "globals.h"
+
+#define NO_SLOT 0xFFFF
+#define WORD_BITS 64
+
+typedef struct POOL pool;
+
+/* Pool: a bitmap with one bit per slot (set when taken), and a summary
+ * with one bit per bitmap word (set while that word has a free slot).
+ * Finding a free slot is one count-trailing-zeros on the summary and one
+ * on the word it points at. */
+
+struct POOL
+{
+	rsize_t object_size;
+	rsize_t object_count;
+	rsize_t word_count;
+	rsize_t summary_count;
+	uint64_t * summary;
+	uint64_t words[];
+};
+
+boolean pool_holds(pool * slots, rsize_t slot);
+
+pool * new_pool(rsize_t object_size, rsize_t object_count)
+{
+	assert(0 < object_size);
+	assert(0 < object_count);
+
+	pool * slots = NULL;
+	rsize_t word_count = (object_count + WORD_BITS - 1) / WORD_BITS;
+	rsize_t summary_count = (word_count + WORD_BITS - 1) / WORD_BITS;
+	rsize_t i;
+
+	if (0 < object_size && 0 < object_count)
+	{
+		slots = malloc(sizeof(pool) + (word_count + summary_count) * sizeof(uint64_t));
+		assert(NULL != slots);
+	}
+
+	if (NULL != slots)
+	{
+		slots->object_size = object_size;
+		slots->object_count = object_count;
+		slots->word_count = word_count;
+		slots->summary_count = summary_count;
+		slots->summary = slots->words + word_count;
+
+		memset(slots->words, 0, word_count * sizeof(uint64_t));
+		memset(slots->summary, 0, summary_count * sizeof(uint64_t));
+
+		/* Slots past the end of the pool are marked taken for good */
+
+		if (0 != object_count % WORD_BITS)
+		{
+			slots->words[word_count - 1] = ~0ULL << (object_count % WORD_BITS);
+		}
+
+		for (i = 0; i < word_count; i++)
+		{
+			slots->summary[i / WORD_BITS] |= 1ULL << (i % WORD_BITS);
+		}
+	}
+
+	return slots;
+}
+
+rsize_t pool_take(pool * slots)
+{
+	assert(NULL != slots);
+
+	rsize_t slot = NO_SLOT;
+	rsize_t summary_index = 0;
+	rsize_t word_index;
+	rsize_t bit;
+
+	if (NULL != slots)
+	{
+		while (summary_index < slots->summary_count && 0 == slots->summary[summary_index])
+		{
+			summary_index++;
+		}
+
+		if (summary_index < slots->summary_count)
+		{
+			word_index = summary_index * WORD_BITS
+				+ __builtin_ctzll(slots->summary[summary_index]);
+			bit = __builtin_ctzll(~slots->words[word_index]);
+
+			slots->words[word_index] |= 1ULL << bit;
+
+			if (~0ULL == slots->words[word_index])
+			{
+				slots->summary[summary_index] &= ~(1ULL << (word_index % WORD_BITS));
+			}
+
+			slot = word_index * WORD_BITS + bit;
+			assert(slot < slots->object_count);
+		}
+	}
+
+	return slot;
+}
+
+boolean pool_release(pool * slots, rsize_t slot)
+{
+	assert(NULL != slots);
+
+	boolean success = pool_holds(slots, slot);
+
+	if (success)
+	{
+		slots->words[slot / WORD_BITS] &= ~(1ULL << (slot % WORD_BITS));
+		slots->summary[slot / WORD_BITS / WORD_BITS] |= 1ULL << (slot / WORD_BITS % WORD_BITS);
+	}
+
+	return success;
+}
+
+boolean pool_holds(pool * slots, rsize_t slot)
+{
+	return NULL != slots && slot < slots->object_count
+		&& 0 != (slots->words[slot / WORD_BITS] & (1ULL << (slot % WORD_BITS)));
+}
+
+rsize_t pool_object_size(pool * slots)
+{
+	assert(NULL != slots);
+
+	return slots->object_size;
+}
+
+rsize_t pool_object_count(pool * slots)
+{
+	assert(NULL != slots);
+
+	return slots->object_count;
+}
+
+void destroy_pool(pool * slots)
+{
+	free(slots);
+}
@@ -0,0 +1,31 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef _POOL_H
+#define _POOL_H
+
+/* A pool tracks equally sized slots with one bit per slot. */
+
+#define NO_SLOT 0xFFFF
+
+typedef struct POOL pool;
+
+pool * new_pool(rsize_t object_size, rsize_t object_count);
+rsize_t pool_take(pool * slots);
+boolean pool_release(pool * slots, rsize_t slot);
+boolean pool_holds(pool * slots, rsize_t slot);
+rsize_t pool_object_size(pool * slots);
+rsize_t pool_object_count(pool * slots);
+void destroy_pool(pool * slots);
+
+#endif
@@ -0,0 +1,148 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "globals.h"
+#include "region_list.h"
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+static pthread_mutex_t prefault_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prefault_finished = PTHREAD_COND_INITIALIZER;
+
+void prefault_now(region_node * region);
+void * prefault_thread(void * region);
+
+/* MADV_POPULATE_WRITE needs Linux 5.14. Elsewhere each page gets an atomic
+ * or of zero, which write faults it without changing a byte that another
+ * thread may be writing. */
+
+void prefault_now(region_node * region)
+{
+	assert(NULL != region);
+
+	uintptr_t page_size = sysconf(_SC_PAGESIZE);
+	uintptr_t first_page;
+	uintptr_t last_page;
+	char * byte;
+	char * end;
+
+	if (NULL != region && NULL != region->data && 0 < region->size)
+	{
+		byte = region->data;
+		end = byte + region->size;
+		first_page = (uintptr_t)byte & ~(page_size - 1);
+		last_page = ((uintptr_t)end + page_size - 1) & ~(page_size - 1);
+
+		if (0 != madvise((void *)first_page, last_page - first_page, MADV_POPULATE_WRITE))
+		{
+			while (byte < end)
+			{
+				__atomic_fetch_or(byte, 0, __ATOMIC_RELAXED);
+				byte = (char *)(((uintptr_t)byte & ~(page_size - 1)) + page_size);
+			}
+		}
+	}
+}
+
+/* Falls back to prefaulting on the caller if no thread can be started */
+
+void prefault_later(region_node * region)
+{
+	assert(NULL != region);
+
+	pthread_t warmer;
+	boolean started = false;
+
+	if (NULL != region)
+	{
+		pthread_mutex_lock(&prefault_lock);
+
+		region->prefaulting = true;
+		started = 0 == pthread_create(&warmer, NULL, prefault_thread, region);
+
+		if (started)
+		{
+			pthread_detach(warmer);
+		}
+		else
+		{
+			region->prefaulting = false;
+		}
+
+		pthread_mutex_unlock(&prefault_lock);
+
+		if (!started)
+		{
+			prefault_now(region);
+		}
+	}
+}
+
+boolean prefault_done(region_node * region)
+{
+	assert(NULL != region);
+
+	boolean done = false;
+
+	if (NULL != region)
+	{
+		pthread_mutex_lock(&prefault_lock);
+		done = !region->prefaulting;
+		pthread_mutex_unlock(&prefault_lock);
+	}
+
+	return done;
+}
+
+/* A region must not be released while its pages are being touched */
+
+void prefault_wait(region_node * region)
+{
+	assert(NULL != region);
+
+	if (NULL != region)
+	{
+		pthread_mutex_lock(&prefault_lock);
+
+		while (region->prefaulting)
+		{
+			pthread_cond_wait(&prefault_finished, &prefault_lock);
+		}
+
+		pthread_mutex_unlock(&prefault_lock);
+	}
+}
+
+void * prefault_thread(void * region)
+{
+	region_node * warming = region;
+
+	prefault_now(warming);
+
+	pthread_mutex_lock(&prefault_lock);
+	warming->prefaulting = false;
+	pthread_cond_broadcast(&prefault_finished);
+	pthread_mutex_unlock(&prefault_lock);
+
+	return NULL;
+}
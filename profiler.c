@@ -0,0 +1,457 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "globals.h"
+#include "profiler.h"
+
+#define MAX_FRAMES 32
+#define SKIPPED_FRAMES 2
+#define REGION_NAME_LENGTH 32
+#define SITE_BUCKETS 1024
+#define SAMPLE_BUCKETS 4096
+
+typedef struct PROFILE_SITE profile_site;
+typedef struct PROFILE_SAMPLE profile_sample;
+
+/* A call site is a region name plus the stack that called ralloc. Bytes
+ * are estimates: each sample stands for the bytes allocated since the one
+ * before it. */
+
+struct PROFILE_SITE
+{
+	profile_site * next;
+	unsigned long hash;
+	char region[REGION_NAME_LENGTH];
+	int depth;
+	void * frames[MAX_FRAMES];
+	double live_bytes;
+	double total_bytes;
+	unsigned long total_samples;
+};
+
+/* A sampled block that has not been freed yet. */
+
+struct PROFILE_SAMPLE
+{
+	profile_sample * next;
+	void * block;
+	profile_site * site;
+	double weight;
+};
+
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static int profile_active = 0;
+static double mean_interval = 0.0;
+static unsigned long profile_generation = 0;
+static profile_site * sites[SITE_BUCKETS];
+static profile_sample * samples[SAMPLE_BUCKETS];
+static unsigned long live_samples = 0;
+static unsigned int bucket_samples[SAMPLE_BUCKETS];
+static __thread double bytes_until_sample = 0.0;
+static __thread unsigned long thread_generation = 0;
+static __thread uint64_t random_state = 0;
+
+double next_interval();
+profile_site * find_site(const char * region_name, void * frames[], int depth);
+unsigned long hash_site(const char * region_name, void * frames[], int depth);
+unsigned long hash_block(void * block);
+void clear_profile();
+void write_frame(FILE * file, void * frame);
+
+/* Start sampling about once every sample_bytes bytes allocated. Starting
+ * again throws away the previous profile. */
+
+boolean rprofile_start(unsigned int sample_bytes)
+{
+	assert(0 < sample_bytes);
+
+	boolean success = false;
+
+	if (0 < sample_bytes)
+	{
+		pthread_mutex_lock(&profile_lock);
+
+		clear_profile();
+		mean_interval = sample_bytes;
+		profile_generation++;
+		__atomic_store_n(&profile_active, 1, __ATOMIC_RELEASE);
+
+		pthread_mutex_unlock(&profile_lock);
+
+		success = true;
+	}
+
+	return success;
+}
+
+/* Stop sampling. The profile is kept, so it can still be dumped. */
+
+void rprofile_stop()
+{
+	__atomic_store_n(&profile_active, 0, __ATOMIC_RELEASE);
+}
+
+/* Write the profile in folded stack format, one line per call site:
+ * the region, then the frames from the outermost caller down to the one
+ * that called ralloc, separated by semicolons, then the bytes. Frames are
+ * named with dladdr where possible, so link with -rdynamic for names of
+ * functions in the executable. */
+
+boolean rprofile_dump(const char * path, rprofile_kind kind)
+{
+	assert(NULL != path);
+
+	boolean success = false;
+	FILE * file = NULL;
+	profile_site * site;
+	double bytes;
+	int bucket;
+	int i;
+
+	if (NULL != path)
+	{
+		file = fopen(path, "w");
+	}
+
+	if (NULL != file)
+	{
+		pthread_mutex_lock(&profile_lock);
+
+		for (bucket = 0; bucket < SITE_BUCKETS; bucket++)
+		{
+			for (site = sites[bucket]; NULL != site; site = site->next)
+			{
+				bytes = RPROFILE_LIVE == kind ? site->live_bytes : site->total_bytes;
+
+				if (0.5 <= bytes)
+				{
+					fprintf(file, "region:%s", site->region);
+
+					for (i = site->depth - 1; 0 <= i; i--)
+					{
+						fputc(';', file);
+						write_frame(file, site->frames[i]);
+					}
+
+					fprintf(file, " %.0f\n", bytes);
+				}
+			}
+		}
+
+		pthread_mutex_unlock(&profile_lock);
+
+		success = 0 == fclose(file);
+	}
+
+	return success;
+}
+
+int profiling()
+{
+	return __atomic_load_n(&profile_active, __ATOMIC_RELAXED);
+}
+
+/* Each thread counts down the bytes to its next sample. The gaps between
+ * samples are drawn from an exponential distribution, so every byte is
+ * equally likely to be sampled whatever the allocation pattern. A sample
+ * of block_size bytes is then weighted by the chance it had of being
+ * picked, which keeps the byte totals unbiased. */
+
+void profile_allocation(const char * region_name, void * block, unsigned short block_size)
+{
+	void * frames[MAX_FRAMES + SKIPPED_FRAMES];
+	profile_sample * sample;
+	profile_site * site;
+	double weight;
+	int depth;
+	unsigned long bucket;
+
+	if (thread_generation != profile_generation)
+	{
+		thread_generation = profile_generation;
+		bytes_until_sample = next_interval();
+	}
+
+	bytes_until_sample -= block_size;
+
+	if (0 < bytes_until_sample)
+	{
+		return;
+	}
+
+	bytes_until_sample = next_interval();
+	weight = block_size / (1.0 - exp(-block_size / mean_interval));
+	depth = backtrace(frames, MAX_FRAMES + SKIPPED_FRAMES) - SKIPPED_FRAMES;
+	depth = 0 < depth ? depth : 0;
+
+	sample = malloc(sizeof(profile_sample));
+	assert(NULL != sample);
+
+	pthread_mutex_lock(&profile_lock);
+
+	site = find_site(region_name, frames + SKIPPED_FRAMES, depth);
+
+	if (NULL != site)
+	{
+		site->live_bytes += weight;
+		site->total_bytes += weight;
+		site->total_samples++;
+	}
+
+	if (NULL != site && NULL != sample)
+	{
+		bucket = hash_block(block);
+		sample->block = block;
+		sample->site = site;
+		sample->weight = weight;
+		sample->next = samples[bucket];
+		samples[bucket] = sample;
+		__atomic_add_fetch(&bucket_samples[bucket], 1, __ATOMIC_RELEASE);
+		__atomic_add_fetch(&live_samples, 1, __ATOMIC_RELAXED);
+		sample = NULL;
+	}
+
+	pthread_mutex_unlock(&profile_lock);
+
+	free(sample);
+}
+
+/* Most frees are of blocks that were never sampled, so the block's bucket
+ * is checked without the lock first, and the lock is only taken when the
+ * bucket holds a sample. A block is recorded before ralloc returns it, so
+ * its own free cannot miss it. */
+
+void profile_free(void * block)
+{
+	profile_sample ** link;
+	profile_sample * found = NULL;
+	unsigned long bucket = hash_block(block);
+
+	if (0 == __atomic_load_n(&live_samples, __ATOMIC_RELAXED)
+			|| 0 == __atomic_load_n(&bucket_samples[bucket], __ATOMIC_ACQUIRE))
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&profile_lock);
+
+	for (link = &samples[bucket]; NULL != *link && NULL == found; )
+	{
+		if ((*link)->block == block)
+		{
+			found = *link;
+			*link = found->next;
+			found->site->live_bytes -= found->weight;
+			__atomic_sub_fetch(&bucket_samples[bucket], 1, __ATOMIC_RELAXED);
+			__atomic_sub_fetch(&live_samples, 1, __ATOMIC_RELAXED);
+		}
+		else
+		{
+			link = &(*link)->next;
+		}
+	}
+
+	pthread_mutex_unlock(&profile_lock);
+
+	free(found);
+}
+
+/* A destroyed region frees all its blocks at once. */
+
+void profile_forget(void * data, unsigned short data_size)
+{
+	profile_sample ** link;
+	profile_sample * found;
+	char * start = data;
+	int bucket;
+
+	if (0 == __atomic_load_n(&live_samples, __ATOMIC_RELAXED))
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&profile_lock);
+
+	for (bucket = 0; bucket < SAMPLE_BUCKETS; bucket++)
+	{
+		link = &samples[bucket];
+
+		while (NULL != *link)
+		{
+			found = *link;
+
+			if ((char *)found->block >= start && (char *)found->block < start + data_size)
+			{
+				*link = found->next;
+				found->site->live_bytes -= found->weight;
+				__atomic_sub_fetch(&bucket_samples[bucket], 1, __ATOMIC_RELAXED);
+				__atomic_sub_fetch(&live_samples, 1, __ATOMIC_RELAXED);
+				free(found);
+			}
+			else
+			{
+				link = &found->next;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&profile_lock);
+}
+
+/* Exponentially distributed with the configured mean, from a per-thread
+ * xorshift generator. */
+
+double next_interval()
+{
+	double uniform;
+
+	if (0 == random_state)
+	{
+		random_state = (uint64_t)(uintptr_t)&random_state ^ (uint64_t)time(NULL)
+			^ 0x9E3779B97F4A7C15ULL;
+	}
+
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+
+	uniform = ((random_state >> 11) + 1.0) / 9007199254740993.0;
+
+	return -log(uniform) * mean_interval;
+}
+
+/* Called with profile_lock held. */
+
+profile_site * find_site(const char * region_name, void * frames[], int depth)
+{
+	unsigned long hash = hash_site(region_name, frames, depth);
+	profile_site * site = sites[hash % SITE_BUCKETS];
+
+	while (NULL != site && (site->hash != hash || site->depth != depth
+				|| 0 != strncmp(site->region, region_name, REGION_NAME_LENGTH - 1)
+				|| 0 != memcmp(site->frames, frames, depth * sizeof(void *))))
+	{
+		site = site->next;
+	}
+
+	if (NULL == site)
+	{
+		site = calloc(1, sizeof(profile_site));
+		assert(NULL != site);
+
+		if (NULL != site)
+		{
+			site->hash = hash;
+			site->depth = depth;
+			strncpy(site->region, region_name, REGION_NAME_LENGTH - 1);
+			memcpy(site->frames, frames, depth * sizeof(void *));
+			site->next = sites[hash % SITE_BUCKETS];
+			sites[hash % SITE_BUCKETS] = site;
+		}
+	}
+
+	return site;
+}
+
+unsigned long hash_site(const char * region_name, void * frames[], int depth)
+{
+	unsigned long hash = 14695981039346656037UL;
+	int i;
+
+	for (i = 0; i < REGION_NAME_LENGTH - 1 && '\0' != region_name[i]; i++)
+	{
+		hash = (hash ^ (unsigned char)region_name[i]) * 1099511628211UL;
+	}
+
+	for (i = 0; i < depth; i++)
+	{
+		hash = (hash ^ (uintptr_t)frames[i]) * 1099511628211UL;
+	}
+
+	return hash;
+}
+
+unsigned long hash_block(void * block)
+{
+	return ((uintptr_t)block >> 3) * 0x9E3779B97F4A7C15ULL >> 52 & (SAMPLE_BUCKETS - 1);
+}
+
+/* Called with profile_lock held. */
+
+void clear_profile()
+{
+	profile_site * site;
+	profile_sample * sample;
+	int i;
+
+	for (i = 0; i < SITE_BUCKETS; i++)
+	{
+		while (NULL != (site = sites[i]))
+		{
+			sites[i] = site->next;
+			free(site);
+		}
+	}
+
+	for (i = 0; i < SAMPLE_BUCKETS; i++)
+	{
+		while (NULL != (sample = samples[i]))
+		{
+			samples[i] = sample->next;
+			free(sample);
+		}
+
+		__atomic_store_n(&bucket_samples[i], 0, __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&live_samples, 0, __ATOMIC_RELAXED);
+}
+
+/* Return addresses point just past the call, so look up the byte before
+ * them. */
+
+void write_frame(FILE * file, void * frame)
+{
+	Dl_info info;
+	char * address = (char *)frame - 1;
+
+	if (0 != dladdr(address, &info) && NULL != info.dli_sname)
+	{
+		fprintf(file, "%s", info.dli_sname);
+	}
+	else if (0 != dladdr(address, &info) && NULL != info.dli_fname)
+	{
+		fprintf(file, "%s+0x%lx", strrchr(info.dli_fname, '/') ? strrchr(info.dli_fname, '/') + 1
+				: info.dli_fname, (unsigned long)(address - (char *)info.dli_fbase));
+	}
+	else
+	{
+		fprintf(file, "%p", frame);
+	}
+}
@@ -0,0 +1,141 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "globals.h"
+#include "region_list.h"
+#include "backing.h"
+#include "prefault.h"
+
+#define RECLAIM_QUEUE_SIZE 32
+
+/* Regions waiting to be torn down. Each entry is a chain of detached
+ * regions linked through next. */
+
+static region_node * queue[RECLAIM_QUEUE_SIZE];
+static int queue_head = 0;
+static int queue_count = 0;
+static boolean reclaiming = false;
+static boolean started = false;
+
+static pthread_t reclaimer;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_filled = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_drained = PTHREAD_COND_INITIALIZER;
+
+void reclaim_now(region_node * regions);
+void * reclaim_loop(void * unused);
+
+boolean reclaim_later(region_node * regions)
+{
+	assert(NULL != regions);
+
+	boolean queued = false;
+
+	if (NULL != regions)
+	{
+		pthread_mutex_lock(&queue_lock);
+
+		if (!started)
+		{
+			started = 0 == pthread_create(&reclaimer, NULL, reclaim_loop, NULL);
+
+			if (started)
+			{
+				pthread_detach(reclaimer);
+			}
+		}
+
+		queued = started && queue_count < RECLAIM_QUEUE_SIZE;
+
+		if (queued)
+		{
+			queue[(queue_head + queue_count) % RECLAIM_QUEUE_SIZE] = regions;
+			queue_count++;
+
+			pthread_cond_signal(&queue_filled);
+		}
+
+		pthread_mutex_unlock(&queue_lock);
+	}
+
+	return queued;
+}
+
+void reclaim_now(region_node * regions)
+{
+	region_node * next;
+
+	while (NULL != regions)
+	{
+		next = regions->next;
+
+		prefault_wait(regions);
+		decommit_backing(regions);
+		release_backing(regions);
+
+		free(regions->name);
+		free(regions);
+
+		regions = next;
+	}
+}
+
+void reclaim_wait()
+{
+	pthread_mutex_lock(&queue_lock);
+
+	while (0 < queue_count || reclaiming)
+	{
+		pthread_cond_wait(&queue_drained, &queue_lock);
+	}
+
+	pthread_mutex_unlock(&queue_lock);
+}
+
+void * reclaim_loop(void * unused)
+{
+	region_node * regions;
+
+	pthread_mutex_lock(&queue_lock);
+
+	while (true)
+	{
+		while (0 == queue_count)
+		{
+			pthread_cond_wait(&queue_filled, &queue_lock);
+		}
+
+		regions = queue[queue_head];
+		queue_head = (queue_head + 1) % RECLAIM_QUEUE_SIZE;
+		queue_count--;
+		reclaiming = true;
+
+		pthread_mutex_unlock(&queue_lock);
+		reclaim_now(regions);
+		pthread_mutex_lock(&queue_lock);
+
+		reclaiming = false;
+
+		if (0 == queue_count)
+		{
+			pthread_cond_broadcast(&queue_drained);
+		}
+	}
+
+	return NULL;
+}
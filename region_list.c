@@ -17,20 +17,8 @@
 #include <assert.h>
 
 #include "globals.h"
-
-typedef struct REGION_NODE region_node;
-
-/* Memory region node */
-
-struct REGION_NODE
-{
-	char * name;
-	rsize_t size;
-	rsize_t bytes_used;
-	void * data; 
-	void * block_list;
-	region_node * next;
-};
+#include "region_list.h"
+#include "backing.h"
 
 static region_node * top = NULL;
 static region_node * traverse_region = NULL;
@@ -117,14 +105,13 @@ boolean delete_region(const char * target)
 				top = current_region->next;
 			}
 
-			free(current_region->name);
-			current_region->name = NULL;
-			success = current_region->name == NULL;
+			release_backing(current_region);
+			success = current_region->data == NULL;
 			assert(success);
 
-			free(current_region->data);
-			current_region->data = NULL;
-			success = success && current_region->data == NULL;
+			free(current_region->name);
+			current_region->name = NULL;
+			success = success && current_region->name == NULL;
 			assert(success);
 
 			free(current_region);
@@ -132,15 +119,158 @@ boolean delete_region(const char * target)
 			success = success && current_region == NULL;
 			assert(success);
 
-			if (success)
+			/* The list search that confirms it only runs in debug builds */
+
+			deleted = success;
+			assert(!search_region(target));
+		}
+	}
+
+	return deleted;
+}
+
+boolean unlink_region(region_node * target)
+{
+	assert(NULL != target);
+
+	boolean unlinked = false;
+	region_node * current_region = top;
+	region_node * previous_region = NULL;
+
+	while (NULL != current_region && target != current_region)
+	{
+		previous_region = current_region;
+		current_region = current_region->next;
+	}
+
+	if (NULL != current_region)
+	{
+		if (NULL != previous_region)
+		{
+			previous_region->next = current_region->next;
+		}
+		else
+		{
+			top = current_region->next;
+		}
+
+		current_region->next = NULL;
+		unlinked = true;
+	}
+
+	return unlinked;
+}
+
+/* Unlink every region below ancestor in a single pass and return them
+ * chained through next. Nothing is freed here, so parent chains stay
+ * valid for the whole walk. */
+
+region_node * detach_descendants(region_node * ancestor)
+{
+	assert(NULL != ancestor);
+
+	region_node * detached = NULL;
+	region_node * current_region = top;
+	region_node * previous_region = NULL;
+	region_node * next;
+	region_node * relative;
+
+	while (NULL != current_region)
+	{
+		next = current_region->next;
+		relative = current_region->parent;
+
+		while (NULL != relative && ancestor != relative)
+		{
+			relative = relative->parent;
+		}
+
+		if (NULL != relative)
+		{
+			if (NULL != previous_region)
+			{
+				previous_region->next = next;
+			}
+			else
 			{
-				deleted = !search_region(target);
-				assert(deleted);
+				top = next;
 			}
+
+			current_region->next = detached;
+			detached = current_region;
 		}
+		else
+		{
+			previous_region = current_region;
+		}
+
+		current_region = next;
 	}
 
-	return deleted;
+	return detached;
+}
+
+/* A region is in a prefix's subtree if its name, or the name of any of
+ * its ancestors, starts with the prefix. */
+
+boolean prefix_matches(region_node * region, const char * prefix, boolean include_self)
+{
+	assert(NULL != region);
+	assert(NULL != prefix);
+
+	size_t prefix_length = strlen(prefix);
+	region_node * relative = include_self ? region : region->parent;
+	boolean matched = false;
+
+	while (NULL != relative && !matched)
+	{
+		matched = strncmp(relative->name, prefix, prefix_length) == 0;
+		relative = relative->parent;
+	}
+
+	return matched;
+}
+
+/* Unlink, in a single pass, every region below a region whose name starts
+ * with prefix, and the matching regions themselves if include_matches is
+ * set. They come back chained through next, like detach_descendants. */
+
+region_node * detach_matching(const char * prefix, boolean include_matches)
+{
+	assert(NULL != prefix);
+
+	region_node * detached = NULL;
+	region_node * current_region = top;
+	region_node * previous_region = NULL;
+	region_node * next;
+
+	while (NULL != prefix && NULL != current_region)
+	{
+		next = current_region->next;
+
+		if (prefix_matches(current_region, prefix, include_matches))
+		{
+			if (NULL != previous_region)
+			{
+				previous_region->next = next;
+			}
+			else
+			{
+				top = next;
+			}
+
+			current_region->next = detached;
+			detached = current_region;
+		}
+		else
+		{
+			previous_region = current_region;
+		}
+
+		current_region = next;
+	}
+
+	return detached;
 }
 
 region_node * return_region(const char * target)
@@ -22,12 +22,30 @@ struct REGION_NODE
 	rsize_t size;
 	rsize_t bytes_used;
 	void * data;
-	void * block_list;
+	void * block_table;
+	void * pool;
+	void * frames;
+	void * large;
+	void * gap_index;
+	region_backing backing;
+	numa_policy numa;
+	int numa_node;
+	placement_policy placement;
+	rsize_t next_fit;
+	void * mapping;
+	size_t mapping_size;
+	int fd;
+	boolean prefaulting;
+	region_node * parent;
 	region_node * next;
 };
 
 region_node * insert();
 boolean delete_region(const char * target);
+boolean unlink_region(region_node * target);
+region_node * detach_descendants(region_node * ancestor);
+boolean prefix_matches(region_node * region, const char * prefix, boolean include_self);
+region_node * detach_matching(const char * prefix, boolean include_matches);
 boolean search_region(const char * target);
 region_node * return_region(const char * target);
 region_node * first_region();
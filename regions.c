@@ -18,15 +18,55 @@
 
 #include "globals.h"
 #include "region_list.h"
-#include "block_list.h"
+#include "block_table.h"
+#include "pool.h"
+#include "frame.h"
+#include "large.h"
+#include "gap_index.h"
+#include "numa.h"
+#include "trace.h"
+#include "profiler.h"
+#include "backing.h"
+#include "reclaimer.h"
+#include "prefault.h"
 
 #define RSIZE_T_MAX 65528
 #define ONE_HUNDRED 100
+#define INITIAL_TABLE_CAPACITY 16
+
+typedef region_node * region_handle;
 
 static region_node * chosen_region = NULL;
 
+void * ralloc_in(region_handle region, rsize_t block_size);
+void * ralloc_rounded_in(region_handle region, rsize_t rounded_size);
+rsize_t rsize_in(region_handle region, void * block_ptr);
+boolean rfree_in(region_handle region, void * block_ptr);
+void * rrealloc_in(region_handle region, void * block_ptr, rsize_t block_size);
+region_handle rchosen_handle();
+region_mark rmark();
+boolean rrelease(region_mark mark);
 rsize_t round_to_block(rsize_t input);
-void zero_block_data(block_node * block);
+void zero_block_data(void * block_start, rsize_t block_size);
+void * allocate_in(region_node * region, rsize_t block_size, rsize_t rounded_size);
+void index_gaps(region_node * region);
+void * allocate_block(region_node * region, rsize_t rounded_size);
+rsize_t place_block(region_node * region, rsize_t rounded_size);
+rsize_t region_block_size(region_node * region, void * block_ptr);
+boolean large_block(region_node * region, void * block_ptr);
+boolean release_block(region_node * region, void * block_ptr);
+boolean resize_block(region_node * region, void * block_ptr, rsize_t block_size,
+		rsize_t rounded_size);
+region_node * new_mapped_region(const char * region_name);
+void discard_region(region_node * region);
+void release_since(region_node * region, unsigned int clock);
+void destroy_released_children(region_node * region);
+void reset_region(region_node * region);
+void stats_of(region_node * region, region_stats * stats);
+void trace_init(region_node * region);
+boolean dump_large_object(void * object, rsize_t object_size, void * context);
+boolean return_to_parent(region_node * region);
+void destroy_descendants(region_node * region);
 
 boolean rinit(const char * region_name, rsize_t region_size)
 {
@@ -49,30 +89,41 @@ boolean rinit(const char * region_name, rsize_t region_size)
 			chosen_region->name = (char *)malloc(strlen(region_name) + 1);
 			assert(NULL != chosen_region->name);
 
-			chosen_region->size = rounded_size;
-
 			chosen_region->bytes_used = 0;
-
-			chosen_region->data = malloc(rounded_size);
+			chosen_region->parent = NULL;
+			chosen_region->pool = NULL;
+			chosen_region->frames = NULL;
+			chosen_region->gap_index = NULL;
+			chosen_region->numa = NUMA_DEFAULT;
+			chosen_region->numa_node = -1;
+			chosen_region->placement = FIRST_FIT;
+			chosen_region->next_fit = 0;
+			chosen_region->fd = -1;
+			chosen_region->prefaulting = false;
+			chosen_region->large = NULL;
+
+			heap_backing(chosen_region, rounded_size);
 			assert(NULL != chosen_region->data);
 
-			chosen_region->block_list = new_block_list();
+			chosen_region->block_table = alloc_block_table(INITIAL_TABLE_CAPACITY);
 
 			if (NULL != chosen_region->name && NULL != chosen_region->data
-					&& NULL != chosen_region->block_list)
+					&& NULL != chosen_region->block_table)
 			{
 				strcpy(chosen_region->name, region_name);
 				assert(strcmp(region_name, chosen_region->name) == 0);
+				index_gaps(chosen_region);
 				success = true;
+
+				if (tracing())
+				{
+					trace_init(chosen_region);
+				}
 			}
 			else
 			{
-				if (NULL != chosen_region->block_list)
-				{
-					destroy_block_list(chosen_region->block_list);
-					assert(NULL == chosen_region->block_list);
-				}
-
+				unlink_region(chosen_region);
+				free(chosen_region->block_table);
 				free(chosen_region->name);
 				free(chosen_region->data);
 				free(chosen_region);
@@ -85,248 +136,1810 @@ boolean rinit(const char * region_name, rsize_t region_size)
 	return success;
 }
 
-boolean rchoose(const char * region_name)
+/* rinit with options. Without options, or with the default NUMA and
+ * placement policies and no cloning, this is plain rinit. */
+
+boolean rinit_ex(const char * region_name, rsize_t region_size, const rinit_options * options)
 {
 	assert(NULL != region_name);
+	assert(!search_region(region_name));
+	assert(0 < region_size);
 
-	region_node * chosen_one;
+	region_node * new_region;
+	rsize_t rounded_size;
 	boolean success = false;
 
-	if (NULL != region_name)
+	if (NULL == options || (NUMA_DEFAULT == options->numa && FIRST_FIT == options->placement
+				&& !options->cloneable))
 	{
-		chosen_one = return_region(region_name);
+		success = rinit(region_name, region_size);
+	}
+	else if (NULL != region_name && !search_region(region_name) && 0 < region_size)
+	{
+		new_region = new_mapped_region(region_name);
+		rounded_size = round_to_block(region_size);
 
-		if (NULL != chosen_one)
+		if (NULL != new_region && options->cloneable)
 		{
-			chosen_region = chosen_one;
-			success = true;
+			success = memfd_backing(new_region, rounded_size, options->numa, options->numa_node);
+		}
+		else if (NULL != new_region && NUMA_DEFAULT == options->numa)
+		{
+			success = heap_backing(new_region, rounded_size)
+				&& NULL != (new_region->block_table = alloc_block_table(INITIAL_TABLE_CAPACITY));
+		}
+		else if (NULL != new_region)
+		{
+			success = numa_backing(new_region, rounded_size, options->numa, options->numa_node);
+		}
+
+		if (success)
+		{
+			new_region->placement = options->placement;
+			index_gaps(new_region);
+			chosen_region = new_region;
+
+			if (tracing())
+			{
+				trace_init(new_region);
+			}
+		}
+		else if (NULL != new_region)
+		{
+			release_backing(new_region);
+			discard_region(new_region);
+		}
+	}
+
+	if (success && NULL != options && 0 < options->large_threshold)
+	{
+		chosen_region->large = new_large_objects(options->large_threshold);
+		success = NULL != chosen_region->large;
+
+		if (!success)
+		{
+			rdestroy(region_name);
 		}
 	}
 
+	if (success && NULL != options && PREFAULT_NOW == options->prefault)
+	{
+		prefault_now(chosen_region);
+	}
+	else if (success && NULL != options && PREFAULT_ASYNC == options->prefault)
+	{
+		prefault_later(chosen_region);
+	}
+
 	return success;
 }
 
-const char * rchosen()
+boolean rinit_file(const char * region_name, const char * path, rsize_t region_size)
 {
-	const char * chosen_name = NULL;
+	assert(NULL != region_name);
+	assert(NULL != path);
+	assert(!search_region(region_name));
+	assert(0 < region_size);
 
-	if (chosen_region != NULL)
+	region_node * new_region;
+	boolean success = false;
+
+	if (NULL != region_name && NULL != path && !search_region(region_name) && 0 < region_size)
 	{
-		assert(NULL != chosen_region->name);
+		new_region = new_mapped_region(region_name);
 
-		if (NULL != chosen_region->name)
+		success = NULL != new_region
+			&& file_backing(new_region, path, round_to_block(region_size));
+
+		if (success)
 		{
-			chosen_name = chosen_region->name;
-			assert(strcmp(chosen_name, chosen_region->name) == 0);
+			new_region->bytes_used = table_bytes_used(new_region->block_table);
+			index_gaps(new_region);
+			chosen_region = new_region;
+
+			if (tracing())
+			{
+				trace_init(new_region);
+			}
+		}
+		else if (NULL != new_region)
+		{
+			discard_region(new_region);
 		}
 	}
 
-	return chosen_name;
+	return success;
 }
 
-void * ralloc(rsize_t block_size)
+boolean rinit_shared(const char * region_name, rsize_t region_size)
 {
-	assert(0 < block_size);
-	assert(NULL != chosen_region);
-	assert(NULL != chosen_region->block_list);
-	assert(NULL != chosen_region->data);
-
-	boolean success = 0 < block_size
-		&& NULL != chosen_region
-		&& NULL != chosen_region->block_list
-		&& NULL != chosen_region->data;
+	assert(NULL != region_name);
+	assert(!search_region(region_name));
+	assert(0 < region_size);
 
-	block_node * new_block = NULL;
-	void * block_data_start = NULL;
-	rsize_t rounded_size = round_to_block(block_size);
+	region_node * new_region;
+	boolean success = false;
 
-	if (success && rounded_size <= (chosen_region->size - chosen_region->bytes_used))
+	if (NULL != region_name && !search_region(region_name) && 0 < region_size)
 	{
-		new_block = add_block(rounded_size, chosen_region->block_list,
-				chosen_region->size, chosen_region->data);
+		new_region = new_mapped_region(region_name);
 
-		if (NULL != new_block)
-		{
-			chosen_region->bytes_used += rounded_size;
+		success = NULL != new_region
+			&& shared_backing(new_region, round_to_block(region_size), true);
 
-			zero_block_data(new_block);
+		if (success)
+		{
+			chosen_region = new_region;
 
-			block_data_start = new_block->block_start;
+			if (tracing())
+			{
+				trace_init(new_region);
+			}
+		}
+		else if (NULL != new_region)
+		{
+			discard_region(new_region);
 		}
 	}
 
-	return block_data_start;
+	return success;
 }
 
-rsize_t rsize(void * block_ptr)
+boolean rattach(const char * region_name)
 {
-	assert(NULL != chosen_region);
-	block_node * search_block;
-	rsize_t block_size = 0;
+	assert(NULL != region_name);
+	assert(!search_region(region_name));
 
-	if (NULL != block_ptr && NULL != chosen_region)
+	region_node * new_region;
+	boolean success = false;
+
+	if (NULL != region_name && !search_region(region_name))
 	{
-		search_block = find_block(block_ptr, chosen_region->block_list);
+		new_region = new_mapped_region(region_name);
 
-		if (NULL != search_block)
+		success = NULL != new_region && shared_backing(new_region, 0, false);
+
+		if (success)
 		{
-			assert(0 < search_block->size);
+			chosen_region = new_region;
 
-			if (0 < search_block->size)
+			if (tracing())
 			{
-				block_size = search_block->size;
+				trace_init(new_region);
 			}
 		}
+		else if (NULL != new_region)
+		{
+			discard_region(new_region);
+		}
 	}
 
-	return block_size;
+	return success;
 }
 
-boolean rfree(void * block_ptr)
+/* A frame region is frame_count frames of frame_size bytes. ralloc bumps
+ * blocks off the current frame and rframe_advance empties the oldest one,
+ * so a block lives until frame_count - 1 more advances. */
+
+boolean rinit_frames(const char * region_name, rsize_t frame_size, rsize_t frame_count)
 {
-	assert(NULL != block_ptr);
-	assert(NULL != chosen_region);
+	assert(NULL != region_name);
+	assert(!search_region(region_name));
+	assert(0 < frame_size);
+	assert(0 < frame_count);
+
+	region_node * new_region = NULL;
+	unsigned int region_size = 0;
 	boolean success = false;
-	region_node * current_region;
-	block_node * target = NULL;
-	int block_size;
 
-	if (NULL != chosen_region && NULL != block_ptr)
+	if (NULL != region_name && !search_region(region_name)
+			&& 0 < frame_size && 0 < frame_count)
 	{
-		current_region = first_region();
+		frame_size = round_to_block(frame_size);
+		region_size = (unsigned int)frame_size * frame_count;
+	}
+
+	if (0 < region_size && region_size <= RSIZE_T_MAX)
+	{
+		new_region = new_mapped_region(region_name);
+
+		success = NULL != new_region
+			&& heap_backing(new_region, region_size)
+			&& NULL != (new_region->frames = new_frames(frame_size, frame_count));
 
-		while (NULL != current_region && NULL == target)
+		if (success)
 		{
-			target = find_block(block_ptr, current_region->block_list);
-			current_region = next_region();
-		}
+			chosen_region = new_region;
 
-		if (NULL != target)
+			if (tracing())
+			{
+				trace_init(new_region);
+			}
+		}
+		else if (NULL != new_region)
 		{
-			block_size = target->size;
+			release_backing(new_region);
+			discard_region(new_region);
 		}
+	}
 
-		success = delete_block(target, chosen_region->block_list);
+	return success;
+}
 
-		if (success)
+boolean rframe_advance()
+{
+	assert(NULL != chosen_region);
+	assert(NULL != chosen_region->frames);
+
+	boolean success = NULL != chosen_region && NULL != chosen_region->frames;
+	frames * ring;
+
+	if (success)
+	{
+		ring = chosen_region->frames;
+		chosen_region->bytes_used -= frame_advance(ring);
+
+		/* Frames do not record their blocks, so one record frees the frame */
+
+		if (tracing())
 		{
-			chosen_region->bytes_used -= block_size;
+			trace_event(TRACE_FREE, chosen_region, frame_size(ring),
+					frame_current(ring) * frame_size(ring));
 		}
+
+		profile_forget((char *)chosen_region->data + frame_current(ring) * frame_size(ring),
+				frame_size(ring));
 	}
 
 	return success;
 }
 
-void rdestroy(const char * region_name)
+boolean rinit_pool(const char * region_name, rsize_t object_size, rsize_t object_count)
 {
 	assert(NULL != region_name);
-	boolean success;
-	region_node * target_region;
+	assert(!search_region(region_name));
+	assert(0 < object_size);
+	assert(0 < object_count);
 
-	if (NULL != region_name)
+	region_node * new_region = NULL;
+	unsigned int region_size = 0;
+	boolean success = false;
+
+	if (NULL != region_name && !search_region(region_name)
+			&& 0 < object_size && 0 < object_count)
 	{
-		target_region = return_region(region_name);
+		object_size = round_to_block(object_size);
+		region_size = (unsigned int)object_size * object_count;
+	}
 
-		if (NULL != target_region)
+	if (0 < region_size && region_size <= RSIZE_T_MAX)
+	{
+		new_region = new_mapped_region(region_name);
+
+		success = NULL != new_region
+			&& heap_backing(new_region, region_size)
+			&& NULL != (new_region->pool = new_pool(object_size, object_count));
+
+		if (success)
 		{
-			success = strcmp(region_name, target_region->name) == 0;
+			chosen_region = new_region;
 
-			if (success)
+			if (tracing())
 			{
-				success = destroy_block_list(target_region->block_list);
-				assert(success);
+				trace_init(new_region);
+			}
+		}
+		else if (NULL != new_region)
+		{
+			release_backing(new_region);
+			discard_region(new_region);
+		}
+	}
 
-				if (success)
-				{
-					success = delete_region(region_name);
-					assert(success);
+	return success;
+}
 
-					if (success)
-					{
-						if (target_region == chosen_region)
-						{
-							chosen_region = NULL;
-							assert(chosen_region == NULL);
-						}
+boolean rinit_child(const char * parent_name, const char * region_name, rsize_t region_size)
+{
+	assert(NULL != parent_name);
+	assert(NULL != region_name);
+	assert(!search_region(region_name));
+	assert(0 < region_size);
 
-						target_region = NULL;
-						assert(target_region == NULL);
-					}
-				}
+	region_node * parent_region = NULL;
+	region_node * new_region = NULL;
+	void * data_start = NULL;
+	rsize_t rounded_size;
+	boolean success = false;
+
+	if (NULL != parent_name && NULL != region_name && !search_region(region_name)
+			&& 0 < region_size)
+	{
+		parent_region = return_region(parent_name);
+	}
+
+	/* A child would be overwritten when its frame was reused */
+
+	if (NULL != parent_region && NULL == parent_region->frames)
+	{
+		rounded_size = round_to_block(region_size);
+
+		lock_backing(parent_region);
+		data_start = allocate_block(parent_region, rounded_size);
+		unlock_backing(parent_region);
+	}
+
+	if (NULL != data_start)
+	{
+		new_region = new_mapped_region(region_name);
+
+		success = NULL != new_region
+			&& child_backing(new_region, data_start, rounded_size);
+
+		if (success)
+		{
+			new_region->parent = parent_region;
+			index_gaps(new_region);
+			chosen_region = new_region;
+
+			if (tracing())
+			{
+				trace_init(new_region);
 			}
 		}
+		else
+		{
+			if (NULL != new_region)
+			{
+				discard_region(new_region);
+			}
+
+			lock_backing(parent_region);
+			release_block(parent_region, data_start);
+			parent_region->bytes_used -= rounded_size;
+			unlock_backing(parent_region);
+		}
 	}
+
+	return success;
 }
 
-void rdump()
+/* The clone gets the source's blocks at the same offsets, so offset
+ * references stay valid. A cloneable source's pages are mapped
+ * copy-on-write; any other region with a block table is copied. Pools
+ * and frames cannot be cloned. */
+
+boolean rclone(const char * source_name, const char * clone_name)
 {
-	region_node * current_region = first_region();
-	block_node * current_block;
-	float percent;
+	assert(NULL != source_name);
+	assert(NULL != clone_name);
+	assert(!search_region(clone_name));
 
-	while (NULL != current_region)
-	{
-		printf("REGION NAME: \t%s\n", current_region->name);
-		printf("SIZE (BYTES): \t%d\n", current_region->size);
-		printf("USED (BYTES): \t%d\n", current_region->bytes_used);
+	region_node * source = NULL;
+	region_node * clone = NULL;
+	boolean success = false;
 
-		percent = ONE_HUNDRED - (((float)current_region->bytes_used /
-					(float)current_region->size) * ONE_HUNDRED);
+	if (NULL != source_name && NULL != clone_name && !search_region(clone_name))
+	{
+		source = return_region(source_name);
+	}
 
-		printf("FREE SPACE: \t%.2f %%\n\n", percent);
+	if (NULL != source && NULL != source->block_table)
+	{
+		clone = new_mapped_region(clone_name);
 
-		current_block = first_block(current_region->block_list);
+		lock_backing(source);
+		success = NULL != clone && clone_backing(clone, source);
 
-		if (NULL != current_block)
+		if (success)
 		{
-			printf("\tBLOCKS:\n\n");
+			clone->bytes_used = source->bytes_used;
+			clone->placement = source->placement;
+			clone->next_fit = source->next_fit;
 		}
 
-		while (NULL != current_block)
+		if (success && NULL != source->large)
 		{
-			printf("\t\t%p\n", current_block->block_start);
-			printf("\t\t%d bytes\n\n", current_block->size);
-
-			current_block = current_block->next;
+			clone->large = new_large_objects(large_threshold(source->large));
+			success = NULL != clone->large;
 		}
 
-		printf("\n");
+		unlock_backing(source);
+	}
 
-		current_region = next_region();
+	if (success)
+	{
+		index_gaps(clone);
+		chosen_region = clone;
+
+		if (tracing())
+		{
+			trace_init(clone);
+		}
+	}
+	else if (NULL != clone)
+	{
+		release_backing(clone);
+		discard_region(clone);
 	}
+
+	return success;
 }
 
-rsize_t round_to_block(rsize_t input)
+/* A region is ready once any prefaulting asked for by rinit_ex is done */
+
+boolean rready(const char * region_name)
 {
-	assert(0 < input);
-	rsize_t rounded = input;
+	assert(NULL != region_name);
 
-	if (RSIZE_T_MAX < input)
-	{
-		rounded = RSIZE_T_MAX;
-	}
-	else if (0 < input && input % BLOCK_ALIGNMENT != 0)
+	region_node * region = NULL;
+
+	if (NULL != region_name)
 	{
-		rounded += BLOCK_ALIGNMENT - (input % BLOCK_ALIGNMENT);
+		region = return_region(region_name);
 	}
 
-	assert(rounded % BLOCK_ALIGNMENT == 0);
-
-	return rounded;
+	return NULL != region && prefault_done(region);
 }
 
-void zero_block_data(block_node * block)
+boolean rwait_ready(const char * region_name)
 {
-	assert(NULL != block);
-	unsigned char * ptr;
+	assert(NULL != region_name);
 
-	if (NULL != block)
+	region_node * region = NULL;
+
+	if (NULL != region_name)
 	{
-		for (ptr = block->block_start; (void *)ptr < block->block_start + block->size; ptr++)
-		{
-			*ptr = 0;
-			assert(*ptr == 0);
-		}
+		region = return_region(region_name);
 	}
+
+	if (NULL != region)
+	{
+		prefault_wait(region);
+	}
+
+	return NULL != region;
 }
 
+boolean rchoose(const char * region_name)
+{
+	assert(NULL != region_name);
+
+	region_node * chosen_one;
+	boolean success = false;
+
+	if (NULL != region_name)
+	{
+		chosen_one = return_region(region_name);
+
+		if (NULL != chosen_one)
+		{
+			chosen_region = chosen_one;
+			success = true;
+		}
+	}
+
+	return success;
+}
+
+const char * rchosen()
+{
+	const char * chosen_name = NULL;
+
+	if (chosen_region != NULL)
+	{
+		assert(NULL != chosen_region->name);
+
+		if (NULL != chosen_region->name)
+		{
+			chosen_name = chosen_region->name;
+			assert(strcmp(chosen_name, chosen_region->name) == 0);
+		}
+	}
+
+	return chosen_name;
+}
+
+/* The chosen region itself, for the strings and containers that remember
+ * the region they were made in. Not part of the public interface. */
+
+region_handle rchosen_handle()
+{
+	return chosen_region;
+}
+
+void * rbase()
+{
+	void * data_start = NULL;
+
+	if (NULL != chosen_region)
+	{
+		data_start = chosen_region->data;
+	}
+
+	return data_start;
+}
+
+void * rbase_in(region_handle region)
+{
+	assert(NULL != region);
+
+	return NULL != region ? region->data : NULL;
+}
+
+/* Checked offsets: a pointer outside the region's data encodes as 0, like
+ * NULL, and an offset past its end decodes to NULL. */
+
+roff32 roff_encode_in(region_handle region, const void * block_ptr)
+{
+	assert(NULL != region);
+
+	roff32 offset = 0;
+	const char * data_start;
+
+	if (NULL != region && NULL != block_ptr)
+	{
+		data_start = region->data;
+
+		if ((const char *)block_ptr >= data_start
+				&& (const char *)block_ptr < data_start + region->size)
+		{
+			offset = (const char *)block_ptr - data_start + 1;
+		}
+	}
+
+	return offset;
+}
+
+void * roff_decode_in(region_handle region, roff32 offset)
+{
+	assert(NULL != region);
+
+	void * block_ptr = NULL;
+
+	if (NULL != region && 0 < offset && offset <= region->size)
+	{
+		block_ptr = (char *)region->data + offset - 1;
+	}
+
+	return block_ptr;
+}
+
+void * ralloc(rsize_t block_size)
+{
+	assert(NULL != chosen_region);
+
+	return ralloc_in(chosen_region, block_size);
+}
+
+rsize_t rsize(void * block_ptr)
+{
+	assert(NULL != chosen_region);
+
+	return rsize_in(chosen_region, block_ptr);
+}
+
+boolean rfree(void * block_ptr)
+{
+	assert(NULL != block_ptr);
+	assert(NULL != chosen_region);
+	boolean success = false;
+	region_node * current_region;
+
+	if (NULL != chosen_region && NULL != block_ptr)
+	{
+		current_region = first_region();
+
+		while (NULL != current_region && !success)
+		{
+			success = rfree_in(current_region, block_ptr);
+			current_region = next_region();
+		}
+	}
+
+	return success;
+}
+
+void * rrealloc(void * block_ptr, rsize_t block_size)
+{
+	assert(NULL != chosen_region);
+
+	return rrealloc_in(chosen_region, block_ptr, block_size);
+}
+
+/* A handle names a region without a lookup by name, and without making
+ * it the chosen region. It stays valid until the region is destroyed. */
+
+region_handle rhandle(const char * region_name)
+{
+	assert(NULL != region_name);
+
+	region_node * region = NULL;
+
+	if (NULL != region_name)
+	{
+		region = return_region(region_name);
+	}
+
+	return region;
+}
+
+void * ralloc_in(region_handle region, rsize_t block_size)
+{
+	assert(0 < block_size);
+	assert(NULL != region);
+	assert(NULL != region->block_table || NULL != region->pool || NULL != region->frames);
+	assert(NULL != region->data);
+
+	boolean success = 0 < block_size
+		&& NULL != region
+		&& (NULL != region->block_table || NULL != region->pool || NULL != region->frames)
+		&& NULL != region->data;
+
+	void * block_data_start = NULL;
+
+	if (success)
+	{
+		block_data_start = allocate_in(region, block_size, round_to_block(block_size));
+	}
+
+	return block_data_start;
+}
+
+/* ralloc_in for a size the caller has already rounded to BLOCK_ALIGNMENT,
+ * as RALLOC_FIXED does at compile time. A size that is not rounded fails
+ * as it would in ralloc_in. */
+
+void * ralloc_rounded_in(region_handle region, rsize_t rounded_size)
+{
+	assert(NULL != region);
+	assert(0 < rounded_size && 0 == rounded_size % BLOCK_ALIGNMENT);
+	assert(rounded_size <= RSIZE_T_MAX);
+
+	void * block_data_start = NULL;
+
+	if (NULL != region && 0 < rounded_size && 0 == rounded_size % BLOCK_ALIGNMENT
+			&& rounded_size <= RSIZE_T_MAX)
+	{
+		block_data_start = allocate_in(region, rounded_size, rounded_size);
+	}
+
+	return block_data_start;
+}
+
+rsize_t rsize_in(region_handle region, void * block_ptr)
+{
+	assert(NULL != region);
+	rsize_t block_size = 0;
+
+	if (NULL != block_ptr && NULL != region)
+	{
+		lock_backing(region);
+		block_size = region_block_size(region, block_ptr);
+		unlock_backing(region);
+	}
+
+	return block_size;
+}
+
+boolean rfree_in(region_handle region, void * block_ptr)
+{
+	assert(NULL != region);
+	assert(NULL != block_ptr);
+	boolean success = false;
+	rsize_t block_size = 0;
+
+	if (NULL != region && NULL != block_ptr)
+	{
+		lock_backing(region);
+		block_size = region_block_size(region, block_ptr);
+
+		if (0 < block_size && large_block(region, block_ptr))
+		{
+			success = large_release(region->large, block_ptr);
+		}
+		else if (0 < block_size)
+		{
+			success = release_block(region, block_ptr);
+
+			if (success)
+			{
+				region->bytes_used -= block_size;
+			}
+
+			if (success && tracing())
+			{
+				trace_event(TRACE_FREE, region, block_size,
+						(char *)block_ptr - (char *)region->data);
+			}
+
+			if (success)
+			{
+				profile_free(block_ptr);
+			}
+		}
+
+		unlock_backing(region);
+	}
+
+	return success;
+}
+
+/* Resize a block where it stands if the space after it allows, and
+ * otherwise move it to a new block. Bytes added in place are zeroed, like
+ * a new block. Returns NULL, leaving the block alone, if there is no room
+ * anywhere or the region does not own the block. */
+
+void * rrealloc_in(region_handle region, void * block_ptr, rsize_t block_size)
+{
+	assert(NULL != region);
+	assert(NULL != block_ptr);
+	assert(0 < block_size);
+
+	void * resized = NULL;
+	rsize_t old_size = 0;
+	rsize_t rounded_size = 0;
+
+	if (NULL != region && NULL != block_ptr && 0 < block_size)
+	{
+		rounded_size = round_to_block(block_size);
+
+		lock_backing(region);
+		old_size = region_block_size(region, block_ptr);
+
+		/* A block grown past the threshold moves to a mapping, as ralloc
+		 * would have put it there */
+
+		if (0 < old_size && !large_block(region, block_ptr)
+				&& (NULL == region->large || large_threshold(region->large) >= block_size)
+				&& resize_block(region, block_ptr, old_size, rounded_size))
+		{
+			resized = block_ptr;
+		}
+
+		unlock_backing(region);
+	}
+
+	if (NULL != resized && NULL == region->pool)
+	{
+		if (tracing())
+		{
+			trace_event(TRACE_FREE, region, old_size, (char *)block_ptr - (char *)region->data);
+			trace_event(TRACE_ALLOC, region, block_size, (char *)block_ptr - (char *)region->data);
+		}
+
+		profile_free(block_ptr);
+
+		if (profiling())
+		{
+			profile_allocation(region->name, block_ptr, block_size);
+		}
+	}
+	else if (0 < old_size && NULL == resized)
+	{
+		resized = ralloc_in(region, block_size);
+
+		if (NULL != resized)
+		{
+			memcpy(resized, block_ptr, old_size < rounded_size ? old_size : rounded_size);
+			rfree_in(region, block_ptr);
+		}
+	}
+
+	return resized;
+}
+
+/* A mark is the chosen region's table clock. Every block stamped after it
+ * goes in one rrelease, however it was placed. Pools keep no stamps, so
+ * they cannot be marked. */
+
+region_mark rmark()
+{
+	assert(NULL != chosen_region);
+
+	region_mark mark = { NULL, 0 };
+
+	if (NULL != chosen_region && NULL != chosen_region->block_table)
+	{
+		lock_backing(chosen_region);
+		mark.region = chosen_region;
+		mark.clock = table_clock(chosen_region->block_table);
+		unlock_backing(chosen_region);
+	}
+
+	return mark;
+}
+
+boolean rrelease(region_mark mark)
+{
+	assert(NULL != mark.region);
+
+	region_node * region = mark.region;
+	boolean success = NULL != region && NULL != region->block_table;
+
+	if (success)
+	{
+		lock_backing(region);
+		release_since(region, mark.clock);
+		destroy_released_children(region);
+		unlock_backing(region);
+	}
+
+	return success;
+}
+
+void rdestroy(const char * region_name)
+{
+	assert(NULL != region_name);
+	boolean success;
+	region_node * target_region;
+
+	if (NULL != region_name)
+	{
+		target_region = return_region(region_name);
+
+		if (NULL != target_region)
+		{
+			success = strcmp(region_name, target_region->name) == 0;
+
+			if (success && tracing())
+			{
+				trace_event(TRACE_DESTROY, target_region, 0, 0);
+			}
+
+			if (success)
+			{
+				if (NULL != target_region->parent)
+				{
+					success = return_to_parent(target_region);
+					assert(success);
+				}
+
+				profile_forget(target_region->data, target_region->size);
+				destroy_descendants(target_region);
+
+				if (success)
+				{
+					success = delete_region(region_name);
+					assert(success);
+
+					if (success)
+					{
+						if (target_region == chosen_region)
+						{
+							chosen_region = NULL;
+							assert(chosen_region == NULL);
+						}
+
+						target_region = NULL;
+						assert(target_region == NULL);
+					}
+				}
+			}
+		}
+	}
+}
+
+/* Unlink the region and its descendants right away and leave freeing and
+ * decommitting their memory to the reclaimer thread. If the reclaim queue
+ * is full the caller does the work itself. */
+
+void rdestroy_async(const char * region_name)
+{
+	assert(NULL != region_name);
+	region_node * target_region = NULL;
+	region_node * current_region;
+
+	if (NULL != region_name)
+	{
+		target_region = return_region(region_name);
+	}
+
+	if (NULL != target_region)
+	{
+		if (tracing())
+		{
+			trace_event(TRACE_DESTROY, target_region, 0, 0);
+		}
+
+		if (NULL != target_region->parent)
+		{
+			return_to_parent(target_region);
+		}
+
+		profile_forget(target_region->data, target_region->size);
+		unlink_region(target_region);
+		target_region->next = detach_descendants(target_region);
+
+		for (current_region = target_region; NULL != current_region;
+				current_region = current_region->next)
+		{
+			if (current_region == chosen_region)
+			{
+				chosen_region = NULL;
+			}
+		}
+
+		if (!reclaim_later(target_region))
+		{
+			reclaim_now(target_region);
+		}
+	}
+}
+
+void rreclaim_wait()
+{
+	reclaim_wait();
+}
+
+boolean rstats(const char * region_name, region_stats * stats)
+{
+	assert(NULL != region_name);
+	assert(NULL != stats);
+
+	region_node * region = NULL;
+
+	if (NULL != region_name && NULL != stats)
+	{
+		region = return_region(region_name);
+	}
+
+	if (NULL != region)
+	{
+		stats_of(region, stats);
+	}
+
+	return NULL != region;
+}
+
+/* Regions whose names start with prefix are matched in one pass over the
+ * region list. Regions below a matched region go with it, since they live
+ * in its blocks. The whole chain goes to the reclaimer thread at once, as
+ * rdestroy_async does, unless its queue is full. */
+
+unsigned int rdestroy_matching(const char * prefix)
+{
+	assert(NULL != prefix);
+
+	region_node * detached = NULL;
+	region_node * current_region;
+	unsigned int destroyed = 0;
+	boolean topmost;
+
+	if (NULL != prefix)
+	{
+		detached = detach_matching(prefix, true);
+	}
+
+	/* Nothing is freed until every region has been looked at, so parent
+	 * chains stay valid */
+
+	for (current_region = detached; NULL != current_region; current_region = current_region->next)
+	{
+		topmost = NULL == current_region->parent
+			|| !prefix_matches(current_region->parent, prefix, true);
+
+		if (topmost && tracing())
+		{
+			trace_event(TRACE_DESTROY, current_region, 0, 0);
+		}
+
+		if (topmost && NULL != current_region->parent)
+		{
+			return_to_parent(current_region);
+		}
+
+		if (topmost)
+		{
+			profile_forget(current_region->data, current_region->size);
+		}
+
+		if (current_region == chosen_region)
+		{
+			chosen_region = NULL;
+		}
+
+		destroyed++;
+	}
+
+	if (NULL != detached && !reclaim_later(detached))
+	{
+		reclaim_now(detached);
+	}
+
+	return destroyed;
+}
+
+/* Empties every matching region. Regions below one are destroyed, since
+ * the blocks they live in are freed. */
+
+unsigned int rreset_matching(const char * prefix)
+{
+	assert(NULL != prefix);
+
+	region_node * detached = NULL;
+	region_node * current_region;
+	unsigned int reset = 0;
+
+	if (NULL != prefix)
+	{
+		detached = detach_matching(prefix, false);
+	}
+
+	for (current_region = detached; NULL != current_region; current_region = current_region->next)
+	{
+		if (current_region == chosen_region)
+		{
+			chosen_region = NULL;
+		}
+	}
+
+	if (NULL != detached && !reclaim_later(detached))
+	{
+		reclaim_now(detached);
+	}
+
+	for (current_region = NULL != prefix ? first_region() : NULL; NULL != current_region;
+			current_region = next_region())
+	{
+		if (prefix_matches(current_region, prefix, true))
+		{
+			reset_region(current_region);
+			reset++;
+		}
+	}
+
+	return reset;
+}
+
+/* Fills in stats, and names if it is not NULL, for up to max_regions
+ * matching regions. Returns how many regions match, which may be more. */
+
+unsigned int rstats_matching(const char * prefix, region_stats stats[], const char * names[],
+		unsigned int max_regions)
+{
+	assert(NULL != prefix);
+	assert(NULL != stats || 0 == max_regions);
+
+	region_node * current_region;
+	unsigned int matched = 0;
+
+	for (current_region = NULL != prefix ? first_region() : NULL; NULL != current_region;
+			current_region = next_region())
+	{
+		if (prefix_matches(current_region, prefix, true))
+		{
+			if (matched < max_regions)
+			{
+				stats_of(current_region, &stats[matched]);
+			}
+
+			if (matched < max_regions && NULL != names)
+			{
+				names[matched] = current_region->name;
+			}
+
+			matched++;
+		}
+	}
+
+	return matched;
+}
+
+/* Replay builds a region for each INIT record. A region that starts out
+ * with blocks, loaded from a file, attached or cloned, also records an
+ * ALLOC for each of them, so their frees can be replayed. */
+
+void trace_init(region_node * region)
+{
+	assert(NULL != region);
+
+	rsize_t i;
+
+	lock_backing(region);
+	trace_event(TRACE_INIT, region, region->size, 0);
+
+	for (i = 0; NULL != region->block_table && i < table_count(region->block_table); i++)
+	{
+		trace_event(TRACE_ALLOC, region, table_size(region->block_table, i),
+				table_offset(region->block_table, i));
+	}
+
+	unlock_backing(region);
+}
+
+void stats_of(region_node * region, region_stats * stats)
+{
+	assert(NULL != region);
+	assert(NULL != stats);
+
+	rsize_t i;
+
+	if (NULL != region && NULL != stats)
+	{
+		memset(stats, 0, sizeof(region_stats));
+
+		lock_backing(region);
+
+		stats->size = region->size;
+		stats->bytes_used = region->bytes_used;
+		stats->block_count = table_count(region->block_table);
+
+		for (i = 0; NULL != region->pool && i < pool_object_count(region->pool); i++)
+		{
+			stats->block_count += pool_holds(region->pool, i);
+		}
+
+		for (i = 0; NULL != region->frames && i < frame_count(region->frames); i++)
+		{
+			stats->block_count += frame_block_count(region->frames, i);
+		}
+
+		if (NULL != region->large)
+		{
+			stats->block_count += large_count(region->large);
+			stats->large_bytes = large_bytes(region->large);
+		}
+
+		unlock_backing(region);
+
+		stats->numa = region->numa;
+		stats->numa_node = region->numa_node;
+		stats->residency_known = numa_residency(region->data, region->size,
+				stats->node_pages, &stats->absent_pages);
+	}
+}
+
+void rdump()
+{
+	region_node * current_region = first_region();
+	rsize_t i;
+	float percent;
+
+	while (NULL != current_region)
+	{
+		lock_backing(current_region);
+
+		printf("REGION NAME: \t%s\n", current_region->name);
+		printf("SIZE (BYTES): \t%d\n", current_region->size);
+		printf("USED (BYTES): \t%d\n", current_region->bytes_used);
+
+		percent = ONE_HUNDRED - (((float)current_region->bytes_used /
+					(float)current_region->size) * ONE_HUNDRED);
+
+		printf("FREE SPACE: \t%.2f %%\n", percent);
+
+		if (NULL != current_region->parent)
+		{
+			printf("PARENT: \t%s\n", current_region->parent->name);
+		}
+
+		printf("\n");
+
+		if (NULL != current_region->block_table)
+		{
+			if (0 < table_count(current_region->block_table))
+			{
+				printf("\tBLOCKS:\n\n");
+			}
+
+			for (i = 0; i < table_count(current_region->block_table); i++)
+			{
+				printf("\t\t%p\n", (char *)current_region->data
+						+ table_offset(current_region->block_table, i));
+				printf("\t\t%d bytes\n\n", table_size(current_region->block_table, i));
+			}
+		}
+
+		if (NULL != current_region->pool)
+		{
+			printf("\tOBJECTS OF %d BYTES:\n\n", pool_object_size(current_region->pool));
+
+			for (i = 0; i < pool_object_count(current_region->pool); i++)
+			{
+				if (pool_holds(current_region->pool, i))
+				{
+					printf("\t\t%p\n", (char *)current_region->data
+							+ i * pool_object_size(current_region->pool));
+				}
+			}
+
+			printf("\n");
+		}
+
+		if (NULL != current_region->frames)
+		{
+			printf("\tFRAMES OF %d BYTES:\n\n", frame_size(current_region->frames));
+
+			for (i = 0; i < frame_count(current_region->frames); i++)
+			{
+				printf("\t\t%p%s\n", (char *)current_region->data
+						+ i * frame_size(current_region->frames),
+						i == frame_current(current_region->frames) ? " (current)" : "");
+				printf("\t\t%d bytes in %d blocks\n\n",
+						frame_bytes_used(current_region->frames, i),
+						frame_block_count(current_region->frames, i));
+			}
+		}
+
+		if (NULL != current_region->large && 0 < large_count(current_region->large))
+		{
+			printf("\tLARGE OBJECTS OVER %d BYTES:\n\n", large_threshold(current_region->large));
+
+			large_foreach(current_region->large, dump_large_object, NULL);
+		}
+
+		printf("\n");
+
+		unlock_backing(current_region);
+		current_region = next_region();
+	}
+}
+
+boolean dump_large_object(void * object, rsize_t object_size, void * context)
+{
+	printf("\t\t%p\n", object);
+	printf("\t\t%d bytes\n\n", object_size);
+
+	return true;
+}
+
+rsize_t round_to_block(rsize_t input)
+{
+	assert(0 < input);
+	rsize_t rounded = input;
+
+	if (RSIZE_T_MAX < input)
+	{
+		rounded = RSIZE_T_MAX;
+	}
+	else if (0 < input && input % BLOCK_ALIGNMENT != 0)
+	{
+		rounded += BLOCK_ALIGNMENT - (input % BLOCK_ALIGNMENT);
+	}
+
+	assert(rounded % BLOCK_ALIGNMENT == 0);
+
+	return rounded;
+}
+
+void zero_block_data(void * block_start, rsize_t block_size)
+{
+	assert(NULL != block_start);
+
+	if (NULL != block_start)
+	{
+		memset(block_start, 0, block_size);
+	}
+}
+
+/* The allocation shared by every ralloc variant. block_size is what the
+ * caller asked for, which traces and profiles record. */
+
+void * allocate_in(region_node * region, rsize_t block_size, rsize_t rounded_size)
+{
+	void * block_data_start;
+	boolean large = NULL != region->large && large_threshold(region->large) < block_size;
+
+	lock_backing(region);
+	block_data_start = large ? large_take(region->large, rounded_size)
+		: allocate_block(region, rounded_size);
+	unlock_backing(region);
+
+	/* Large objects have no offset in the region to trace, and would
+	 * outlive profile_forget when the region goes */
+
+	if (tracing() && !large)
+	{
+		trace_event(TRACE_ALLOC, region, block_size, NULL != block_data_start
+				? (char *)block_data_start - (char *)region->data : TRACE_NO_BLOCK);
+	}
+
+	if (profiling() && !large && NULL != block_data_start)
+	{
+		profile_allocation(region->name, block_data_start, block_size);
+	}
+
+	return block_data_start;
+}
+
+/* Regions private to this process get a gap index over their blocks, so
+ * placement does not scan the table. Shared regions are changed by other
+ * processes too, so they keep scanning. Without the index (or if it
+ * cannot be allocated) the table alone still works. */
+
+void index_gaps(region_node * region)
+{
+	assert(NULL != region);
+
+	rsize_t i;
+
+	if (NULL != region && NULL != region->block_table && SHARED_BACKING != region->backing
+			&& ATTACHED_BACKING != region->backing)
+	{
+		region->gap_index = new_gap_index(region->size);
+
+		for (i = 0; NULL != region->gap_index && i < table_count(region->block_table); i++)
+		{
+			gap_fill(region->gap_index, table_offset(region->block_table, i),
+					table_size(region->block_table, i));
+		}
+	}
+}
+
+void * allocate_block(region_node * region, rsize_t rounded_size)
+{
+	assert(NULL != region);
+	assert(0 == rounded_size % BLOCK_ALIGNMENT);
+
+	void * block_data_start = NULL;
+	rsize_t block_offset;
+	rsize_t slot;
+
+	if (NULL != region->pool)
+	{
+		if (rounded_size <= pool_object_size(region->pool))
+		{
+			slot = pool_take(region->pool);
+			rounded_size = pool_object_size(region->pool);
+
+			if (NO_SLOT != slot)
+			{
+				block_data_start = (char *)region->data + slot * rounded_size;
+			}
+		}
+	}
+	else if (NULL != region->frames)
+	{
+		block_offset = frame_take(region->frames, rounded_size);
+
+		if (NO_ROOM != block_offset)
+		{
+			block_data_start = (char *)region->data + block_offset;
+		}
+	}
+	else if (rounded_size <= (region->size - region->bytes_used))
+	{
+		/* Tables on the heap start small and grow up to one entry per
+		 * aligned block. File and shared tables are created at that size. */
+
+		if (table_full(region->block_table) && FILE_BACKING != region->backing
+				&& SHARED_BACKING != region->backing && ATTACHED_BACKING != region->backing)
+		{
+			region->block_table = grow_block_table(region->block_table,
+					region->size / BLOCK_ALIGNMENT);
+		}
+
+		if (FIRST_FIT == region->placement && NULL == region->gap_index)
+		{
+			block_offset = table_add(region->block_table, rounded_size, region->size);
+		}
+		else
+		{
+			block_offset = place_block(region, rounded_size);
+
+			if (NO_BLOCK != block_offset
+					&& table_insert(region->block_table, block_offset, rounded_size))
+			{
+				if (NULL != region->gap_index)
+				{
+					gap_fill(region->gap_index, block_offset, rounded_size);
+				}
+
+				region->next_fit = block_offset + rounded_size;
+			}
+			else
+			{
+				block_offset = NO_BLOCK;
+			}
+		}
+
+		if (NO_BLOCK != block_offset)
+		{
+			block_data_start = (char *)region->data + block_offset;
+		}
+	}
+
+	if (NULL != block_data_start)
+	{
+		region->bytes_used += rounded_size;
+
+		zero_block_data(block_data_start, rounded_size);
+	}
+
+	return block_data_start;
+}
+
+/* Where a block of rounded_size goes under the region's placement policy.
+ * First fit uses the gap index; the other policies scan the table. */
+
+rsize_t place_block(region_node * region, rsize_t rounded_size)
+{
+	rsize_t block_offset;
+
+	if (NEXT_FIT == region->placement)
+	{
+		block_offset = table_next_gap(region->block_table, rounded_size, region->size,
+				region->next_fit);
+	}
+	else if (BEST_FIT == region->placement)
+	{
+		block_offset = table_best_gap(region->block_table, rounded_size, region->size);
+	}
+	else
+	{
+		block_offset = gap_find(region->gap_index, rounded_size);
+		block_offset = NO_GAP != block_offset ? block_offset : NO_BLOCK;
+	}
+
+	return block_offset;
+}
+
+rsize_t region_block_size(region_node * region, void * block_ptr)
+{
+	assert(NULL != region);
+	assert(NULL != block_ptr);
+
+	rsize_t block_size = 0;
+	char * block_start = block_ptr;
+	char * data_start = region->data;
+	rsize_t object_size;
+
+	if (NULL != region->pool)
+	{
+		object_size = pool_object_size(region->pool);
+
+		if (block_start >= data_start && block_start < data_start + region->size
+				&& 0 == (block_start - data_start) % object_size
+				&& pool_holds(region->pool, (block_start - data_start) / object_size))
+		{
+			block_size = object_size;
+		}
+	}
+	else if (NULL != region->block_table)
+	{
+		if (block_start >= data_start && block_start < data_start + region->size)
+		{
+			block_size = table_find(region->block_table, block_start - data_start);
+		}
+	}
+
+	if (large_block(region, block_ptr))
+	{
+		block_size = large_size(region->large, block_ptr);
+	}
+
+	return block_size;
+}
+
+/* Only a region with a large object threshold has blocks outside its data */
+
+boolean large_block(region_node * region, void * block_ptr)
+{
+	assert(NULL != region);
+
+	char * block_start = block_ptr;
+	char * data_start = region->data;
+
+	return NULL != region->large
+		&& (block_start < data_start || block_start >= data_start + region->size);
+}
+
+boolean release_block(region_node * region, void * block_ptr)
+{
+	assert(NULL != region);
+	assert(NULL != block_ptr);
+
+	boolean success = false;
+	rsize_t block_offset;
+	rsize_t block_size;
+
+	if (NULL != region->pool)
+	{
+		success = pool_release(region->pool, ((char *)block_ptr - (char *)region->data)
+				/ pool_object_size(region->pool));
+	}
+	else if (NULL != region->block_table)
+	{
+		block_offset = (char *)block_ptr - (char *)region->data;
+		block_size = table_find(region->block_table, block_offset);
+		success = table_delete(region->block_table, block_offset);
+
+		if (success && NULL != region->gap_index)
+		{
+			gap_clear(region->gap_index, block_offset, block_size);
+		}
+	}
+
+	return success;
+}
+
+/* Pool objects keep their fixed size, so any size up to it fits. */
+
+boolean resize_block(region_node * region, void * block_ptr, rsize_t block_size,
+		rsize_t rounded_size)
+{
+	assert(NULL != region);
+	assert(NULL != block_ptr);
+
+	boolean success = false;
+	rsize_t block_offset = (char *)block_ptr - (char *)region->data;
+
+	if (NULL != region->pool)
+	{
+		success = rounded_size <= block_size;
+	}
+	else if (NULL != region->block_table)
+	{
+		success = table_resize(region->block_table, block_offset, rounded_size, region->size);
+	}
+
+	if (success && NULL != region->block_table)
+	{
+		if (block_size < rounded_size)
+		{
+			zero_block_data((char *)block_ptr + block_size, rounded_size - block_size);
+			region->bytes_used += rounded_size - block_size;
+		}
+		else
+		{
+			region->bytes_used -= block_size - rounded_size;
+		}
+
+		if (NULL != region->gap_index && block_size < rounded_size)
+		{
+			gap_fill(region->gap_index, block_offset + block_size, rounded_size - block_size);
+		}
+		else if (NULL != region->gap_index && rounded_size < block_size)
+		{
+			gap_clear(region->gap_index, block_offset + rounded_size, block_size - rounded_size);
+		}
+	}
+
+	return success;
+}
+
+region_node * new_mapped_region(const char * region_name)
+{
+	assert(NULL != region_name);
+
+	region_node * new_region = insert();
+	assert(NULL != new_region);
+
+	if (NULL != new_region)
+	{
+		new_region->name = (char *)malloc(strlen(region_name) + 1);
+		assert(NULL != new_region->name);
+
+		new_region->bytes_used = 0;
+		new_region->data = NULL;
+		new_region->parent = NULL;
+		new_region->pool = NULL;
+		new_region->frames = NULL;
+		new_region->gap_index = NULL;
+		new_region->block_table = NULL;
+		new_region->numa = NUMA_DEFAULT;
+		new_region->numa_node = -1;
+		new_region->placement = FIRST_FIT;
+		new_region->next_fit = 0;
+		new_region->fd = -1;
+		new_region->prefaulting = false;
+		new_region->large = NULL;
+		new_region->backing = HEAP_BACKING;
+		new_region->mapping = NULL;
+
+		if (NULL != new_region->name)
+		{
+			strcpy(new_region->name, region_name);
+		}
+		else
+		{
+			discard_region(new_region);
+			new_region = NULL;
+		}
+	}
+
+	return new_region;
+}
+
+void discard_region(region_node * region)
+{
+	assert(NULL != region);
+
+	if (NULL != region)
+	{
+		unlink_region(region);
+		free(region->name);
+		free(region);
+	}
+}
+
+/* Frees every table block stamped after clock. The caller holds the
+ * region's lock. */
+
+void release_since(region_node * region, unsigned int clock)
+{
+	assert(NULL != region);
+	assert(NULL != region->block_table);
+
+	rsize_t block_offset;
+	rsize_t block_size;
+	rsize_t i;
+
+	for (i = 0; i < table_count(region->block_table); i++)
+	{
+		if (table_stamp(region->block_table, i) > clock)
+		{
+			block_offset = table_offset(region->block_table, i);
+			block_size = table_size(region->block_table, i);
+			region->bytes_used -= block_size;
+
+			if (NULL != region->gap_index)
+			{
+				gap_clear(region->gap_index, block_offset, block_size);
+			}
+
+			if (tracing())
+			{
+				trace_event(TRACE_FREE, region, block_size, block_offset);
+			}
+
+			profile_free((char *)region->data + block_offset);
+		}
+	}
+
+	table_truncate(region->block_table, clock);
+}
+
+/* A child made after a mark lives in a block that releasing the mark has
+ * just freed, so it goes too, with everything below it. The parent is
+ * locked by the caller. */
+
+void destroy_released_children(region_node * region)
+{
+	assert(NULL != region);
+	assert(NULL != region->block_table);
+
+	region_node * child = first_region();
+
+	while (NULL != child)
+	{
+		if (region == child->parent && 0 == table_find(region->block_table,
+					(char *)child->data - (char *)region->data))
+		{
+			if (tracing())
+			{
+				trace_event(TRACE_DESTROY, child, 0, 0);
+			}
+
+			profile_forget(child->data, child->size);
+			destroy_descendants(child);
+
+			if (child == chosen_region)
+			{
+				chosen_region = NULL;
+			}
+
+			delete_region(child->name);
+
+			/* The list has changed under the traversal */
+
+			child = first_region();
+		}
+		else
+		{
+			child = next_region();
+		}
+	}
+}
+
+/* Frees every block, whatever kind of region it is */
+
+void reset_region(region_node * region)
+{
+	assert(NULL != region);
+
+	rsize_t object_size;
+	rsize_t i;
+
+	lock_backing(region);
+
+	if (NULL != region->block_table)
+	{
+		release_since(region, 0);
+		region->next_fit = 0;
+	}
+
+	for (i = 0; NULL != region->pool && i < pool_object_count(region->pool); i++)
+	{
+		if (pool_holds(region->pool, i))
+		{
+			object_size = pool_object_size(region->pool);
+			pool_release(region->pool, i);
+
+			if (tracing())
+			{
+				trace_event(TRACE_FREE, region, object_size, i * object_size);
+			}
+
+			profile_free((char *)region->data + i * object_size);
+		}
+	}
+
+	for (i = 0; NULL != region->frames && i < frame_count(region->frames); i++)
+	{
+		frame_advance(region->frames);
+	}
+
+	if (NULL != region->frames && tracing())
+	{
+		trace_event(TRACE_FREE, region, region->size, 0);
+	}
+
+	if (NULL != region->frames)
+	{
+		profile_forget(region->data, region->size);
+	}
+
+	while (NULL != region->large && 0 < large_count(region->large))
+	{
+		large_release(region->large, large_object(region->large, 0));
+	}
+
+	region->bytes_used = 0;
+	unlock_backing(region);
+}
+
+/* Hand a child's data back to its parent when the child is destroyed on
+ * its own. */
+
+boolean return_to_parent(region_node * region)
+{
+	assert(NULL != region);
+	assert(NULL != region->parent);
+
+	region_node * parent_region = region->parent;
+	boolean success = false;
+
+	if (NULL != parent_region)
+	{
+		lock_backing(parent_region);
+		success = release_block(parent_region, region->data);
+
+		if (success)
+		{
+			parent_region->bytes_used -= region->size;
+		}
+
+		unlock_backing(parent_region);
+	}
+
+	return success;
+}
+
+/* Descendants live inside the region's data, so there is nothing to give
+ * back block by block: only their nodes and tables are freed. */
+
+void destroy_descendants(region_node * region)
+{
+	assert(NULL != region);
+
+	region_node * descendant = detach_descendants(region);
+	region_node * next;
+
+	while (NULL != descendant)
+	{
+		next = descendant->next;
+
+		if (descendant == chosen_region)
+		{
+			chosen_region = NULL;
+		}
+
+		release_backing(descendant);
+		free(descendant->name);
+		free(descendant);
+
+		descendant = next;
+	}
+}
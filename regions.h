@@ -14,20 +14,301 @@
 #ifndef _REGIONS_H
 #define _REGIONS_H
 
+#ifdef __cplusplus
+extern "C" {
+
+/* false and true are keywords in C++. An int has the size of the C enum,
+ * so structs and return values keep their layout. */
+
+typedef int boolean;
+#else
 typedef enum {
    false,
    true
 } boolean;
+#endif
 
 typedef unsigned short rsize_t;
 
+/* Region-relative references: the distance from the region's data, plus
+ * one so that 0 stands for NULL. Structures linked with them work at any
+ * address, so the region's data can be copied or mapped elsewhere. A
+ * roff16 reaches anywhere in today's regions; roff32 leaves room to grow
+ * at the same cost as a 32 bit index. */
+
+typedef unsigned short roff16;
+typedef unsigned int roff32;
+
+typedef struct REGION_NODE *region_handle;
+
+#define RSTATS_NODES 64
+
+/* Where a region's pages go on a NUMA machine. NUMA_BIND uses numa_node,
+ * NUMA_INTERLEAVE spreads pages over every allowed node, and NUMA_LOCAL
+ * binds to the node of the thread calling rinit_ex. Machines or kernels
+ * without NUMA support quietly get the default policy. */
+
+typedef enum {
+   NUMA_DEFAULT,
+   NUMA_BIND,
+   NUMA_INTERLEAVE,
+   NUMA_LOCAL
+} numa_policy;
+
+/* Which free gap a block goes in: the lowest one that fits, the first
+ * one that fits after the last block placed, or the smallest one that
+ * fits. */
+
+typedef enum {
+   FIRST_FIT,
+   NEXT_FIT,
+   BEST_FIT
+} placement_policy;
+
+/* When a new region's pages are faulted in: on first use, before rinit_ex
+ * returns, or on a helper thread while the caller goes on. rready says
+ * whether a region has finished warming. */
+
+typedef enum {
+   PREFAULT_NONE,
+   PREFAULT_NOW,
+   PREFAULT_ASYNC
+} prefault_policy;
+
+/* A cloneable region keeps its data in a memfd, so rclone can map it
+ * copy-on-write: a clone shares the source's pages until it writes them.
+ * Pages the clone has not written still show later writes to the source,
+ * so treat a cloned source as a read-only template.
+ *
+ * With a large_threshold, blocks bigger than it get their own mapping
+ * outside the region's data. rfree unmaps them at once and rdestroy takes
+ * the rest. Marks, clones and traces leave them out. */
+
+typedef struct {
+   numa_policy numa;
+   int numa_node;
+   placement_policy placement;
+   boolean cloneable;
+   prefault_policy prefault;
+   rsize_t large_threshold;
+} rinit_options;
+
+/* Which bytes a profile dump counts: those still allocated, or every
+ * byte allocated since rprofile_start. */
+
+typedef enum {
+   RPROFILE_LIVE,
+   RPROFILE_CUMULATIVE
+} rprofile_kind;
+
+/* numa and numa_node are the policy the region actually got. Page counts
+ * are only filled in when residency_known is true. */
+
+typedef struct {
+   rsize_t size;
+   rsize_t bytes_used;
+   rsize_t block_count;
+   numa_policy numa;
+   int numa_node;
+   boolean residency_known;
+   unsigned int node_pages[RSTATS_NODES];
+   unsigned int absent_pages;
+   unsigned int large_bytes;
+} region_stats;
+
+/* A savepoint in the chosen region. rrelease frees every block allocated
+ * after it; marks nest, and releasing an outer mark invalidates the marks
+ * taken inside it. */
+
+typedef struct {
+   region_handle region;
+   unsigned int clock;
+} region_mark;
+
+/* An appendable string in one region. data always ends in a NUL and
+ * grows in place while the space after it is free. */
+
+typedef struct {
+   region_handle region;
+   char *data;
+   rsize_t length;
+   rsize_t capacity;
+} region_buffer;
+
+/* Containers kept in a single block of the region chosen when they were
+ * made. Elements are copied in by value. A map holds at most 1536 keys,
+ * the most a 2048 slot table takes. Growing a map needs room for the old
+ * and new tables at once, so give large maps their capacity up front. */
+
+typedef struct {
+   region_handle region;
+   char *data;
+   rsize_t element_size;
+   rsize_t count;
+   rsize_t capacity;
+} region_vector;
+
+typedef struct {
+   region_handle region;
+   unsigned long long *keys;
+   void **values;
+   unsigned char *states;
+   rsize_t count;
+   rsize_t used;
+   rsize_t capacity;
+} region_map;
+
+typedef struct {
+   region_handle region;
+   char *data;
+   rsize_t element_size;
+   rsize_t head;
+   rsize_t count;
+   rsize_t capacity;
+} region_deque;
+
+/* Called with each live block of a region; returning false ends the walk.
+ * A shared region stays locked throughout; any other region is not locked,
+ * so nothing may allocate or free in it until the walk returns, visitors
+ * included. rforeach_block_parallel splits the blocks over up to
+ * threads threads, which call the visitor concurrently. Frame regions do
+ * not record their blocks and cannot be walked. */
+
+typedef boolean (*rblock_visitor)(void *block, rsize_t size, void *context);
+
 boolean rinit(const char *region_name, rsize_t region_size);
+boolean rinit_ex(const char *region_name, rsize_t region_size, const rinit_options *options);
+boolean rinit_file(const char *region_name, const char *path, rsize_t region_size);
+boolean rinit_shared(const char *region_name, rsize_t region_size);
+boolean rattach(const char *region_name);
+boolean rinit_pool(const char *region_name, rsize_t object_size, rsize_t object_count);
+boolean rinit_frames(const char *region_name, rsize_t frame_size, rsize_t frame_count);
+boolean rframe_advance();
+boolean rinit_child(const char *parent_name, const char *region_name, rsize_t region_size);
+boolean rclone(const char *source_name, const char *clone_name);
+boolean rready(const char *region_name);
+boolean rwait_ready(const char *region_name);
 boolean rchoose(const char *region_name);
 const char *rchosen();
+void *rbase();
+void *rbase_in(region_handle region);
+roff32 roff_encode_in(region_handle region, const void *block_ptr);
+void *roff_decode_in(region_handle region, roff32 offset);
 void *ralloc(rsize_t block_size);
 rsize_t rsize(void *block_ptr);
 boolean rfree(void *block_ptr);
+void *rrealloc(void *block_ptr, rsize_t block_size);
+char *rstrdup(const char *string);
+char *rstrndup(const char *string, rsize_t length);
+char *rprintf(const char *format, ...);
+boolean rbuf_init(region_buffer *buffer, rsize_t capacity);
+boolean rbuf_append(region_buffer *buffer, const void *bytes, rsize_t length);
+boolean rbuf_printf(region_buffer *buffer, const char *format, ...);
+char *rbuf_finish(region_buffer *buffer);
+void rbuf_free(region_buffer *buffer);
+boolean rvec_init(region_vector *vector, rsize_t element_size, rsize_t capacity);
+boolean rvec_push(region_vector *vector, const void *element);
+boolean rvec_pop(region_vector *vector, void *element);
+void *rvec_at(region_vector *vector, rsize_t index);
+void rvec_free(region_vector *vector);
+boolean rmap_init(region_map *map, rsize_t capacity);
+boolean rmap_put(region_map *map, unsigned long long key, void *value);
+boolean rmap_get(region_map *map, unsigned long long key, void **value);
+boolean rmap_remove(region_map *map, unsigned long long key);
+void rmap_free(region_map *map);
+boolean rdeque_init(region_deque *deque, rsize_t element_size, rsize_t capacity);
+boolean rdeque_push_back(region_deque *deque, const void *element);
+boolean rdeque_push_front(region_deque *deque, const void *element);
+boolean rdeque_pop_front(region_deque *deque, void *element);
+boolean rdeque_pop_back(region_deque *deque, void *element);
+void *rdeque_at(region_deque *deque, rsize_t index);
+void rdeque_free(region_deque *deque);
+region_handle rhandle(const char *region_name);
+void *ralloc_in(region_handle region, rsize_t block_size);
+void *ralloc_rounded_in(region_handle region, rsize_t rounded_size);
+rsize_t rsize_in(region_handle region, void *block_ptr);
+boolean rfree_in(region_handle region, void *block_ptr);
+void *rrealloc_in(region_handle region, void *block_ptr, rsize_t block_size);
+region_mark rmark();
+boolean rrelease(region_mark mark);
 void rdestroy(const char *region_name);
+void rdestroy_async(const char *region_name);
+void rreclaim_wait();
+boolean rstats(const char *region_name, region_stats *stats);
+unsigned int rdestroy_matching(const char *prefix);
+unsigned int rreset_matching(const char *prefix);
+unsigned int rstats_matching(const char *prefix, region_stats stats[], const char *names[],
+                             unsigned int max_regions);
+boolean rforeach_block(const char *region_name, rblock_visitor visit, void *context);
+boolean rforeach_block_parallel(const char *region_name, rblock_visitor visit, void *context,
+                                unsigned int threads);
+boolean rprofile_start(unsigned int sample_bytes);
+void rprofile_stop();
+boolean rprofile_dump(const char *path, rprofile_kind kind);
+boolean rtrace_start(const char *path);
+void rtrace_stop();
 void rdump();
 
+/* Fixed size allocation. ralloc_fixed_in rounds inline, so a constant
+ * block_size is rounded and range checked at compile time, and calls
+ * ralloc_rounded_in, which skips the rounding. A pool or frame region then
+ * takes its slot or bumps its frame at once. RALLOC_FIXED takes only a
+ * compile-time constant block_size, and fails to compile for a size no
+ * block can hold. ralloc_fixed_in takes any size, and returns NULL for
+ * one out of range. */
+
+#define RBLOCK_ALIGNMENT 8
+#define RBLOCK_MAX 65528
+#define RROUNDED(block_size) \
+   ((rsize_t)(((block_size) + RBLOCK_ALIGNMENT - 1) & ~(RBLOCK_ALIGNMENT - 1)))
+
+#ifdef __cplusplus
+extern "C++" {
+template <bool InRange> struct RFixedSize;
+template <> struct RFixedSize<true> { enum { checked = 0 }; };
+}
+
+#define RFIXED_CHECK(block_size) \
+   RFixedSize<(0 < (block_size) && (block_size) <= RBLOCK_MAX)>::checked
+#else
+#define RFIXED_CHECK(block_size) \
+   (0 * sizeof(struct { int in_range : 0 < (block_size) && (block_size) <= RBLOCK_MAX ? 1 : -1; }))
+#endif
+
+#define RALLOC_FIXED(region, block_size) \
+   ralloc_fixed_in((region), (block_size) + RFIXED_CHECK(block_size))
+
+static inline void *ralloc_fixed_in(region_handle region, rsize_t block_size)
+{
+   return 0 < block_size && block_size <= RBLOCK_MAX
+      ? ralloc_rounded_in(region, RROUNDED(block_size)) : 0;
+}
+
+/* Unchecked conversions against a base from rbase or rbase_in, for the
+ * inner loops of in-region structures. */
+
+static inline roff16 roff16_encode(const void *base, const void *block_ptr)
+{
+   return 0 == block_ptr ? 0 : (roff16)((const char *)block_ptr - (const char *)base + 1);
+}
+
+static inline void *roff16_decode(const void *base, roff16 offset)
+{
+   return 0 == offset ? 0 : (char *)base + offset - 1;
+}
+
+static inline roff32 roff32_encode(const void *base, const void *block_ptr)
+{
+   return 0 == block_ptr ? 0 : (roff32)((const char *)block_ptr - (const char *)base + 1);
+}
+
+static inline void *roff32_decode(const void *base, roff32 offset)
+{
+   return 0 == offset ? 0 : (char *)base + offset - 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
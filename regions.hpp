@@ -0,0 +1,362 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef _REGIONS_HPP
+#define _REGIONS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "regions.h"
+
+/* C++ access to regions: a Region that owns one region for its lifetime,
+ * a memory_resource for the std::pmr containers, and an allocator for
+ * the ordinary ones. All three allocate with ralloc_in and free with
+ * rfree_in, so nothing they hold comes from the global heap. */
+
+namespace regions
+{
+
+constexpr std::size_t block_alignment = RBLOCK_ALIGNMENT;
+constexpr std::size_t largest_block = RBLOCK_MAX;
+
+/* Blocks are aligned to 8 bytes. A stricter alignment takes alignment
+ * more bytes, and the distance back to the start of the block goes in
+ * the two bytes in front of the pointer handed out. */
+
+inline void * allocate_aligned(region_handle region, std::size_t bytes, std::size_t alignment)
+{
+	void * block = nullptr;
+	std::size_t padded = (0 < bytes ? bytes : 1)
+		+ (block_alignment < alignment ? alignment : 0);
+	std::uintptr_t start;
+	std::uintptr_t aligned;
+
+	if (nullptr != region && padded <= largest_block)
+	{
+		block = ralloc_in(region, static_cast<rsize_t>(padded));
+	}
+
+	if (nullptr != block && block_alignment < alignment)
+	{
+		start = reinterpret_cast<std::uintptr_t>(block);
+		aligned = (start + alignment) & ~(static_cast<std::uintptr_t>(alignment) - 1);
+		reinterpret_cast<unsigned short *>(aligned)[-1] =
+			static_cast<unsigned short>(aligned - start);
+		block = reinterpret_cast<void *>(aligned);
+	}
+
+	if (nullptr == block)
+	{
+		throw std::bad_alloc();
+	}
+
+	return block;
+}
+
+inline void deallocate_aligned(region_handle region, void * block, std::size_t alignment)
+{
+	unsigned char * start = static_cast<unsigned char *>(block);
+
+	if (nullptr != block && block_alignment < alignment)
+	{
+		start -= reinterpret_cast<unsigned short *>(block)[-1];
+	}
+
+	if (nullptr != region && nullptr != block)
+	{
+		rfree_in(region, start);
+	}
+}
+
+/* A fixed size block, rounded by the compiler. Sizes no block can hold do
+ * not compile. */
+
+template <std::size_t Size>
+struct FixedBlock
+{
+	static_assert(0 < Size && Size <= largest_block, "no region block holds this size");
+
+	static constexpr rsize_t rounded = (Size + block_alignment - 1) & ~(block_alignment - 1);
+};
+
+template <std::size_t Size>
+inline void * allocate_fixed(region_handle region)
+{
+	return ralloc_rounded_in(region, FixedBlock<Size>::rounded);
+}
+
+/* Zeroed storage for one T, which must fit the block alignment. */
+
+template <typename T>
+inline T * allocate_object(region_handle region)
+{
+	static_assert(alignof(T) <= block_alignment, "region blocks are only 8 byte aligned");
+
+	return static_cast<T *>(allocate_fixed<sizeof(T)>(region));
+}
+
+/* A typed region-relative reference, the size of its offset type. The
+ * base comes from rbase_in at each use, so the target can move with its
+ * region's data. */
+
+template <typename T, typename Offset = roff16>
+class OffsetPtr
+{
+public:
+	OffsetPtr() noexcept
+		: offset(0)
+	{
+	}
+
+	OffsetPtr(const void * base, const T * target) noexcept
+		: offset(encode(base, target))
+	{
+	}
+
+	T * get(const void * base) const noexcept
+	{
+		return 0 == offset ? nullptr
+			: reinterpret_cast<T *>(const_cast<char *>(static_cast<const char *>(base))
+					+ offset - 1);
+	}
+
+	void set(const void * base, const T * target) noexcept
+	{
+		offset = encode(base, target);
+	}
+
+	explicit operator bool() const noexcept
+	{
+		return 0 != offset;
+	}
+
+	Offset raw() const noexcept
+	{
+		return offset;
+	}
+
+private:
+	static Offset encode(const void * base, const T * target) noexcept
+	{
+		return nullptr == target ? 0 : static_cast<Offset>(reinterpret_cast<const char *>(target)
+				- static_cast<const char *>(base) + 1);
+	}
+
+	Offset offset;
+};
+
+/* Creates a heap region and destroys it, with its descendants, when it
+ * goes out of scope. Moving hands the region to the new owner. */
+
+class Region
+{
+public:
+	Region(const std::string & name, rsize_t size)
+		: region_name(name), region(nullptr)
+	{
+		if (!rinit(region_name.c_str(), size))
+		{
+			throw std::runtime_error("cannot create region " + region_name);
+		}
+
+		region = rhandle(region_name.c_str());
+	}
+
+	Region(const std::string & name, rsize_t size, const rinit_options & options)
+		: region_name(name), region(nullptr)
+	{
+		if (!rinit_ex(region_name.c_str(), size, &options))
+		{
+			throw std::runtime_error("cannot create region " + region_name);
+		}
+
+		region = rhandle(region_name.c_str());
+	}
+
+	Region(Region && other) noexcept
+		: region_name(std::move(other.region_name)), region(other.region)
+	{
+		other.region = nullptr;
+	}
+
+	Region & operator=(Region && other) noexcept
+	{
+		if (this != &other)
+		{
+			destroy();
+			region_name = std::move(other.region_name);
+			region = other.region;
+			other.region = nullptr;
+		}
+
+		return *this;
+	}
+
+	Region(const Region &) = delete;
+	Region & operator=(const Region &) = delete;
+
+	~Region()
+	{
+		destroy();
+	}
+
+	region_handle handle() const
+	{
+		return region;
+	}
+
+	const std::string & name() const
+	{
+		return region_name;
+	}
+
+	void * allocate(rsize_t size)
+	{
+		return ralloc_in(region, size);
+	}
+
+	bool deallocate(void * block)
+	{
+		return rfree_in(region, block);
+	}
+
+	bool choose()
+	{
+		return rchoose(region_name.c_str());
+	}
+
+private:
+	void destroy()
+	{
+		if (nullptr != region)
+		{
+			rdestroy(region_name.c_str());
+			region = nullptr;
+		}
+	}
+
+	std::string region_name;
+	region_handle region;
+};
+
+/* A memory_resource over one region, for std::pmr containers. Two
+ * resources are equal when they use the same region. */
+
+class RegionResource : public std::pmr::memory_resource
+{
+public:
+	explicit RegionResource(region_handle handle) noexcept
+		: region(handle)
+	{
+	}
+
+	explicit RegionResource(Region & owner) noexcept
+		: region(owner.handle())
+	{
+	}
+
+	region_handle handle() const noexcept
+	{
+		return region;
+	}
+
+private:
+	void * do_allocate(std::size_t bytes, std::size_t alignment) override
+	{
+		return allocate_aligned(region, bytes, alignment);
+	}
+
+	void do_deallocate(void * block, std::size_t, std::size_t alignment) override
+	{
+		deallocate_aligned(region, block, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override
+	{
+		const RegionResource * same = dynamic_cast<const RegionResource *>(&other);
+
+		return nullptr != same && region == same->region;
+	}
+
+	region_handle region;
+};
+
+/* An allocator for standard containers that do not take a resource. */
+
+template <typename T>
+class RegionAllocator
+{
+public:
+	typedef T value_type;
+
+	explicit RegionAllocator(region_handle handle) noexcept
+		: region(handle)
+	{
+	}
+
+	explicit RegionAllocator(Region & owner) noexcept
+		: region(owner.handle())
+	{
+	}
+
+	template <typename U>
+	RegionAllocator(const RegionAllocator<U> & other) noexcept
+		: region(other.handle())
+	{
+	}
+
+	T * allocate(std::size_t count)
+	{
+		if (largest_block / sizeof(T) < count)
+		{
+			throw std::bad_alloc();
+		}
+
+		return static_cast<T *>(allocate_aligned(region, count * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T * block, std::size_t)
+	{
+		deallocate_aligned(region, block, alignof(T));
+	}
+
+	region_handle handle() const noexcept
+	{
+		return region;
+	}
+
+private:
+	region_handle region;
+};
+
+template <typename T, typename U>
+bool operator==(const RegionAllocator<T> & left, const RegionAllocator<U> & right) noexcept
+{
+	return left.handle() == right.handle();
+}
+
+template <typename T, typename U>
+bool operator!=(const RegionAllocator<T> & left, const RegionAllocator<U> & right) noexcept
+{
+	return left.handle() != right.handle();
+}
+
+}
+
+#endif
@@ -0,0 +1,312 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <list>
+#include <memory_resource>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+#include "regions.hpp"
+
+/* Tests for the C++ wrappers in regions.hpp. Global operator new is
+ * replaced to count heap allocations, so the tests can check that region
+ * backed containers never reach it. */
+
+void check(int result);
+void test_region_class();
+void test_memory_resource();
+void test_region_allocator();
+void test_fixed_sizes();
+void test_offset_pointers();
+void print_results();
+
+static int tests_failed;
+static unsigned long heap_allocations;
+
+void * operator new(std::size_t size)
+{
+	void * block = std::malloc(0 < size ? size : 1);
+
+	heap_allocations++;
+
+	if (nullptr == block)
+	{
+		throw std::bad_alloc();
+	}
+
+	return block;
+}
+
+void operator delete(void * block) noexcept
+{
+	std::free(block);
+}
+
+void operator delete(void * block, std::size_t) noexcept
+{
+	std::free(block);
+}
+
+int main()
+{
+	std::printf("Initiating Test.\n");
+
+	tests_failed = 0;
+
+	test_region_class();
+
+	test_memory_resource();
+
+	test_region_allocator();
+
+	test_fixed_sizes();
+
+	test_offset_pointers();
+
+	print_results();
+
+	std::printf("\nEnd of Processing.\n");
+
+	return EXIT_SUCCESS;
+}
+
+void check(int result)
+{
+	if (0 == result)
+	{
+		tests_failed++;
+	}
+}
+
+void test_region_class()
+{
+	std::printf("\n====== Begin Testing Region Class. ======\n");
+
+	std::printf("\nA region lives as long as its owner, wherever it moves.\n");
+
+	{
+		regions::Region first("C++ first", 1024);
+		void * block = first.allocate(100);
+
+		check(nullptr != block && rsize_in(first.handle(), block) == 104);
+		check(first.deallocate(block));
+		check(!first.deallocate(block));
+
+		regions::Region second(std::move(first));
+		check(nullptr == first.handle());
+		check(second.handle() == rhandle("C++ first"));
+
+		regions::Region third("C++ third", 64);
+		third = std::move(second);
+		check(nullptr == rhandle("C++ third"));
+		check(third.name() == "C++ first" && third.choose());
+	}
+
+	check(nullptr == rhandle("C++ first"));
+	check(nullptr == rchosen());
+
+#ifdef NDEBUG
+	std::printf("\nA name already in use throws (DNDEBUG only, rinit asserts).\n");
+
+	bool thrown = false;
+
+	try
+	{
+		regions::Region duplicate("C++ twice", 64);
+		regions::Region again("C++ twice", 64);
+	}
+	catch (const std::runtime_error &)
+	{
+		thrown = true;
+	}
+
+	check(thrown && nullptr == rhandle("C++ twice"));
+#endif
+}
+
+void test_memory_resource()
+{
+	std::printf("\n====== Begin Testing Memory Resource. ======\n");
+
+	std::printf("\nPmr containers in a region skip the global heap.\n");
+
+	regions::Region region("C++ resource", -1);
+	regions::RegionResource resource(region);
+	region_stats stats;
+	unsigned long heap_before = heap_allocations;
+
+	{
+		std::pmr::vector<int> numbers(&resource);
+		std::pmr::unordered_map<int, int> squares(&resource);
+
+		for (int i = 0; i < 1000; i++)
+		{
+			numbers.push_back(i);
+		}
+
+		for (int i = 0; i < 200; i++)
+		{
+			squares[i] = i * i;
+		}
+
+		check(numbers.size() == 1000 && numbers[999] == 999);
+		check(squares.size() == 200 && squares[199] == 199 * 199);
+		check(rstats("C++ resource", &stats) && 4000 <= stats.bytes_used);
+	}
+
+	check(heap_allocations == heap_before);
+	check(rstats("C++ resource", &stats) && 0 == stats.bytes_used);
+
+	std::printf("\nStricter alignments are honoured and freed.\n");
+
+	void * aligned = resource.allocate(100, 64);
+	void * page = resource.allocate(10, 4096);
+
+	check(0 == reinterpret_cast<std::uintptr_t>(aligned) % 64);
+	check(0 == reinterpret_cast<std::uintptr_t>(page) % 4096);
+	resource.deallocate(aligned, 100, 64);
+	resource.deallocate(page, 10, 4096);
+	check(rstats("C++ resource", &stats) && 0 == stats.block_count);
+
+	bool thrown = false;
+
+	try
+	{
+		check(nullptr == resource.allocate(70000));
+	}
+	catch (const std::bad_alloc &)
+	{
+		thrown = true;
+	}
+
+	check(thrown);
+
+	regions::RegionResource same(region.handle());
+	check(resource == same && resource != *std::pmr::new_delete_resource());
+}
+
+void test_region_allocator()
+{
+	std::printf("\n====== Begin Testing Region Allocator. ======\n");
+
+	std::printf("\nStandard containers with a region allocator.\n");
+
+	regions::Region region("C++ allocator", 8192);
+	regions::RegionAllocator<double> allocator(region);
+	region_stats stats;
+	unsigned long heap_before = heap_allocations;
+
+	{
+		std::vector<double, regions::RegionAllocator<double>> values(allocator);
+		std::list<int, regions::RegionAllocator<int>> items(allocator);
+
+		for (int i = 0; i < 100; i++)
+		{
+			values.push_back(i / 2.0);
+			items.push_back(i);
+		}
+
+		check(values.size() == 100 && values[99] == 49.5);
+		check(items.size() == 100 && items.back() == 99);
+		check(rstats("C++ allocator", &stats) && 100 <= stats.block_count);
+	}
+
+	check(heap_allocations == heap_before);
+	check(rstats("C++ allocator", &stats) && 0 == stats.block_count);
+
+	regions::RegionAllocator<int> other(region.handle());
+	check(allocator == other);
+
+	bool thrown = false;
+
+	try
+	{
+		allocator.allocate(10000);
+	}
+	catch (const std::bad_alloc &)
+	{
+		thrown = true;
+	}
+
+	check(thrown);
+}
+
+void test_fixed_sizes()
+{
+	struct point
+	{
+		int x;
+		int y;
+		int z;
+	};
+
+	std::printf("\n====== Begin Testing Fixed Sizes. ======\n");
+
+	std::printf("\nRound sizes and types at compile time.\n");
+
+	static_assert(regions::FixedBlock<1>::rounded == 8, "rounds up");
+	static_assert(regions::FixedBlock<24>::rounded == 24, "keeps multiples");
+
+	regions::Region region("C++ fixed", 1024);
+	void * block = regions::allocate_fixed<20>(region.handle());
+	point * object = regions::allocate_object<point>(region.handle());
+
+	check(nullptr != block && rsize_in(region.handle(), block) == 24);
+	check(nullptr != object && rsize_in(region.handle(), object) == 16);
+	check(0 == object->x && 0 == object->z);
+	check(RALLOC_FIXED(region.handle(), 100) != nullptr);
+}
+
+void test_offset_pointers()
+{
+	struct tree_node
+	{
+		regions::OffsetPtr<tree_node> left;
+		regions::OffsetPtr<tree_node> right;
+		int key;
+	};
+
+	std::printf("\n====== Begin Testing Offset Pointers. ======\n");
+
+	std::printf("\nA tree linked by offsets follows its region's data.\n");
+
+	static_assert(sizeof(regions::OffsetPtr<int>) == 2, "16 bit by default");
+	static_assert(sizeof(regions::OffsetPtr<int, roff32>) == 4, "or 32 bit");
+
+	regions::Region region("C++ offsets", 256);
+	void * base = rbase_in(region.handle());
+	tree_node * root = regions::allocate_object<tree_node>(region.handle());
+	tree_node * left = regions::allocate_object<tree_node>(region.handle());
+
+	root->key = 2;
+	left->key = 1;
+	root->left.set(base, left);
+
+	check(!root->right && root->left && root->left.get(base) == left);
+
+	std::vector<char> copy(static_cast<char *>(base), static_cast<char *>(base) + 256);
+	tree_node * moved = reinterpret_cast<tree_node *>(copy.data()
+			+ (reinterpret_cast<char *>(root) - static_cast<char *>(base)));
+
+	check(moved->left.get(copy.data())->key == 1);
+	check(nullptr == moved->right.get(copy.data()));
+}
+
+void print_results()
+{
+	std::printf("\nTests Failed: %d\n", tests_failed);
+}
@@ -0,0 +1,354 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "regions.h"
+#include "trace.h"
+
+#define MAX_REPLAY_REGIONS 4096
+#define SLOTS_PER_REGION 8192
+#define NAME_LENGTH 32
+
+typedef struct REPLAY_REGION replay_region;
+typedef struct REPLAY_RESULT replay_result;
+
+/* A region of the trace while it is replayed: its name here, and where
+ * each of its traced blocks ended up, indexed by traced offset / 8. */
+
+struct REPLAY_REGION
+{
+	unsigned long long traced;
+	char name[NAME_LENGTH];
+	char * base;
+	unsigned int high_water;
+	void ** blocks;
+};
+
+struct REPLAY_RESULT
+{
+	double seconds;
+	unsigned long operations;
+	unsigned long failures;
+	unsigned long peak_footprint;
+};
+
+trace_record * load_trace(const char * path, unsigned long * record_count);
+int by_sequence(const void * left, const void * right);
+replay_region * find_region(replay_region regions[], int region_count,
+		unsigned long long traced);
+replay_result replay(trace_record records[], unsigned long record_count,
+		placement_policy placement);
+boolean parse_policy(const char * name, placement_policy * placement);
+
+int main(int argc, char * argv[])
+{
+	const char * default_policies[] = { "first", "next", "best" };
+	const char ** policies = default_policies;
+	int policy_count = 3;
+	trace_record * records;
+	unsigned long record_count = 0;
+	placement_policy placement;
+	replay_result result;
+	int status = EXIT_SUCCESS;
+	int i;
+
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s trace [first|next|best ...]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (2 < argc)
+	{
+		policies = (const char **)&argv[2];
+		policy_count = argc - 2;
+	}
+
+	records = load_trace(argv[1], &record_count);
+
+	if (NULL == records)
+	{
+		fprintf(stderr, "%s: cannot read trace %s\n", argv[0], argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	printf("%-8s %12s %12s %10s %16s %10s\n", "POLICY", "OPERATIONS", "SECONDS",
+			"NS/OP", "PEAK FOOTPRINT", "FAILURES");
+
+	for (i = 0; i < policy_count; i++)
+	{
+		if (parse_policy(policies[i], &placement))
+		{
+			result = replay(records, record_count, placement);
+
+			printf("%-8s %12lu %12.6f %10.1f %16lu %10lu\n", policies[i],
+					result.operations, result.seconds,
+					0 < result.operations ? result.seconds * 1e9 / result.operations : 0.0,
+					result.peak_footprint, result.failures);
+		}
+		else
+		{
+			fprintf(stderr, "%s: unknown policy %s\n", argv[0], policies[i]);
+			status = EXIT_FAILURE;
+		}
+	}
+
+	free(records);
+
+	return status;
+}
+
+/* Read a whole trace and put it back in the order it happened. */
+
+trace_record * load_trace(const char * path, unsigned long * record_count)
+{
+	FILE * file = fopen(path, "rb");
+	char magic[sizeof(TRACE_MAGIC)];
+	trace_record * records = NULL;
+	long length = 0;
+	boolean success = NULL != file;
+
+	success = success && sizeof(magic) == fread(magic, 1, sizeof(magic), file)
+		&& 0 == memcmp(magic, TRACE_MAGIC, sizeof(magic))
+		&& 0 == fseek(file, 0, SEEK_END) && 0 <= (length = ftell(file))
+		&& 0 == fseek(file, sizeof(magic), SEEK_SET);
+
+	if (success)
+	{
+		*record_count = (length - sizeof(magic)) / sizeof(trace_record);
+		records = malloc(*record_count * sizeof(trace_record) + 1);
+		success = NULL != records
+			&& *record_count == fread(records, sizeof(trace_record), *record_count, file);
+	}
+
+	if (success)
+	{
+		qsort(records, *record_count, sizeof(trace_record), by_sequence);
+	}
+	else
+	{
+		free(records);
+		records = NULL;
+	}
+
+	if (NULL != file)
+	{
+		fclose(file);
+	}
+
+	return records;
+}
+
+int by_sequence(const void * left, const void * right)
+{
+	const trace_record * left_record = left;
+	const trace_record * right_record = right;
+
+	return (left_record->sequence > right_record->sequence)
+		- (left_record->sequence < right_record->sequence);
+}
+
+/* Only live regions are found. Node addresses are reused once a region
+ * is destroyed, but no two live regions share one. */
+
+replay_region * find_region(replay_region regions[], int region_count,
+		unsigned long long traced)
+{
+	replay_region * found = NULL;
+	int i;
+
+	for (i = region_count - 1; 0 <= i && NULL == found; i--)
+	{
+		if (regions[i].traced == traced && NULL != regions[i].blocks)
+		{
+			found = &regions[i];
+		}
+	}
+
+	return found;
+}
+
+/* Replay every record under one placement policy. The footprint of a
+ * region is the end of the highest block it has placed, which is how
+ * much of it has been touched; the peak is the largest sum over the live
+ * regions. */
+
+replay_result replay(trace_record records[], unsigned long record_count,
+		placement_policy placement)
+{
+	static replay_region regions[MAX_REPLAY_REGIONS];
+	replay_result result = { 0.0, 0, 0, 0 };
+	replay_region * region;
+	rinit_options options = { NUMA_DEFAULT, 0, placement };
+	struct timespec start;
+	struct timespec stop;
+	unsigned long footprint = 0;
+	unsigned int block_end;
+	int free_slots[MAX_REPLAY_REGIONS];
+	int free_count = 0;
+	int region_count = 0;
+	int slot = -1;
+	char * block;
+	unsigned long end;
+	unsigned long index;
+	unsigned long i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < record_count; i++)
+	{
+		region = find_region(regions, region_count, records[i].region);
+
+		/* Slots of destroyed regions are reused, so only the regions live at
+		 * once are limited */
+
+		if (TRACE_INIT == records[i].op && NULL == region)
+		{
+			slot = 0 < free_count ? free_slots[--free_count]
+				: region_count < MAX_REPLAY_REGIONS ? region_count++ : -1;
+		}
+
+		if (TRACE_INIT == records[i].op && NULL == region && -1 != slot)
+		{
+			region = &regions[slot];
+			snprintf(region->name, NAME_LENGTH, "replay %d", slot);
+			region->traced = records[i].region;
+			region->high_water = 0;
+			region->blocks = calloc(SLOTS_PER_REGION, sizeof(void *));
+
+			if (NULL != region->blocks && rinit_ex(region->name, records[i].size, &options))
+			{
+				region->base = rbase();
+			}
+			else
+			{
+				free(region->blocks);
+				region->blocks = NULL;
+				free_slots[free_count++] = slot;
+				result.failures++;
+			}
+
+			slot = -1;
+		}
+		else if (TRACE_INIT == records[i].op && NULL == region)
+		{
+			result.failures++;
+		}
+		else if (TRACE_ALLOC == records[i].op && NULL != region)
+		{
+			rchoose(region->name);
+			block = ralloc(records[i].size);
+
+			if (NULL != block)
+			{
+				block_end = block - region->base + rsize(block);
+
+				if (block_end > region->high_water)
+				{
+					footprint += block_end - region->high_water;
+					region->high_water = block_end;
+				}
+
+				/* The traced allocation failed, so nothing will free it */
+
+				if (TRACE_NO_BLOCK != records[i].offset)
+				{
+					region->blocks[records[i].offset / 8] = block;
+				}
+				else
+				{
+					rfree(block);
+				}
+			}
+			else
+			{
+				result.failures++;
+			}
+		}
+		else if (TRACE_FREE == records[i].op && NULL != region)
+		{
+			/* A frame region frees a whole frame in one record */
+
+			rchoose(region->name);
+			end = (unsigned long)records[i].offset + records[i].size;
+
+			for (index = records[i].offset / 8; index < SLOTS_PER_REGION && index < end / 8; index++)
+			{
+				block = region->blocks[index];
+				region->blocks[index] = NULL;
+
+				if (NULL != block)
+				{
+					rfree(block);
+				}
+			}
+		}
+		else if (TRACE_DESTROY == records[i].op && NULL != region)
+		{
+			rdestroy(region->name);
+			footprint -= region->high_water;
+			free(region->blocks);
+			region->blocks = NULL;
+			free_slots[free_count++] = region - regions;
+		}
+
+		result.peak_footprint = footprint > result.peak_footprint
+			? footprint : result.peak_footprint;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	for (i = 0; i < (unsigned long)region_count; i++)
+	{
+		if (NULL != regions[i].blocks)
+		{
+			rdestroy(regions[i].name);
+			free(regions[i].blocks);
+			regions[i].blocks = NULL;
+		}
+	}
+
+	result.seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+	result.operations = record_count;
+
+	return result;
+}
+
+boolean parse_policy(const char * name, placement_policy * placement)
+{
+	boolean success = true;
+
+	if (0 == strcmp(name, "first"))
+	{
+		*placement = FIRST_FIT;
+	}
+	else if (0 == strcmp(name, "next"))
+	{
+		*placement = NEXT_FIT;
+	}
+	else if (0 == strcmp(name, "best"))
+	{
+		*placement = BEST_FIT;
+	}
+	else
+	{
+		success = false;
+	}
+
+	return success;
+}
@@ -0,0 +1,275 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+
+#include "regions.h"
+
+#define MIN_BUFFER 64
+
+/* Strings and buffers built in region memory. Everything goes through
+ * ralloc_in and rrealloc_in, so a buffer that is the last block in its
+ * region keeps growing in place. */
+
+region_handle rchosen_handle();
+boolean rbuf_reserve(region_buffer * buffer, unsigned int extra);
+boolean rbuf_vprintf(region_buffer * buffer, const char * format, va_list arguments);
+
+char * rstrdup(const char * string)
+{
+	assert(NULL != string);
+
+	char * copy = NULL;
+
+	if (NULL != string)
+	{
+		copy = rstrndup(string, strnlen(string, RBLOCK_MAX));
+	}
+
+	return copy;
+}
+
+char * rstrndup(const char * string, rsize_t length)
+{
+	assert(NULL != string);
+	assert(NULL != rchosen_handle());
+
+	char * copy = NULL;
+	boolean success = NULL != string && NULL != rchosen_handle();
+
+	if (success)
+	{
+		length = strnlen(string, length);
+		success = length < RBLOCK_MAX;
+	}
+
+	if (success)
+	{
+		copy = ralloc_in(rchosen_handle(), length + 1);
+	}
+
+	if (NULL != copy)
+	{
+		memcpy(copy, string, length);
+		copy[length] = '\0';
+	}
+
+	return copy;
+}
+
+/* Formats straight into a block of the chosen region, which is grown and
+ * formatted again only if the text does not fit, then trimmed to size. */
+
+char * rprintf(const char * format, ...)
+{
+	assert(NULL != format);
+
+	region_buffer buffer;
+	va_list arguments;
+	char * text = NULL;
+
+	if (NULL != format && rbuf_init(&buffer, MIN_BUFFER))
+	{
+		va_start(arguments, format);
+
+		if (rbuf_vprintf(&buffer, format, arguments))
+		{
+			text = rbuf_finish(&buffer);
+		}
+		else
+		{
+			rbuf_free(&buffer);
+		}
+
+		va_end(arguments);
+	}
+
+	return text;
+}
+
+/* A buffer stays with the region chosen when it was made. */
+
+boolean rbuf_init(region_buffer * buffer, rsize_t capacity)
+{
+	assert(NULL != buffer);
+	assert(NULL != rchosen_handle());
+
+	boolean success = false;
+
+	if (NULL != buffer && NULL != rchosen_handle())
+	{
+		buffer->region = rchosen_handle();
+		buffer->data = ralloc_in(buffer->region, 0 < capacity ? capacity : MIN_BUFFER);
+		buffer->length = 0;
+		buffer->capacity = 0;
+
+		success = NULL != buffer->data;
+
+		if (success)
+		{
+			buffer->capacity = rsize_in(buffer->region, buffer->data);
+		}
+	}
+
+	return success;
+}
+
+boolean rbuf_append(region_buffer * buffer, const void * bytes, rsize_t length)
+{
+	assert(NULL != buffer && NULL != buffer->data);
+	assert(NULL != bytes || 0 == length);
+
+	boolean success = NULL != buffer && (NULL != bytes || 0 == length)
+		&& rbuf_reserve(buffer, length);
+
+	if (success)
+	{
+		memcpy(buffer->data + buffer->length, bytes, length);
+		buffer->length += length;
+		buffer->data[buffer->length] = '\0';
+	}
+
+	return success;
+}
+
+boolean rbuf_printf(region_buffer * buffer, const char * format, ...)
+{
+	assert(NULL != buffer && NULL != buffer->data);
+	assert(NULL != format);
+
+	boolean success = false;
+	va_list arguments;
+
+	if (NULL != buffer && NULL != format)
+	{
+		va_start(arguments, format);
+		success = rbuf_vprintf(buffer, format, arguments);
+		va_end(arguments);
+	}
+
+	return success;
+}
+
+/* Trim the buffer to its text and hand the text over. The buffer is left
+ * empty, and the text is freed like any other block. */
+
+char * rbuf_finish(region_buffer * buffer)
+{
+	assert(NULL != buffer && NULL != buffer->data);
+
+	char * text = NULL;
+	char * trimmed;
+
+	if (NULL != buffer && NULL != buffer->data)
+	{
+		text = buffer->data;
+		trimmed = rrealloc_in(buffer->region, text, buffer->length + 1);
+		text = NULL != trimmed ? trimmed : text;
+
+		buffer->data = NULL;
+		buffer->length = 0;
+		buffer->capacity = 0;
+	}
+
+	return text;
+}
+
+void rbuf_free(region_buffer * buffer)
+{
+	assert(NULL != buffer);
+
+	if (NULL != buffer && NULL != buffer->data)
+	{
+		rfree_in(buffer->region, buffer->data);
+
+		buffer->data = NULL;
+		buffer->length = 0;
+		buffer->capacity = 0;
+	}
+}
+
+/* Make room for extra more bytes and the NUL, at least doubling so a run
+ * of appends moves the buffer a logarithmic number of times at most. */
+
+boolean rbuf_reserve(region_buffer * buffer, unsigned int extra)
+{
+	unsigned int needed = buffer->length + extra + 1;
+	unsigned int capacity = buffer->capacity;
+	boolean success = NULL != buffer->data && needed <= RBLOCK_MAX;
+	char * grown;
+
+	if (success && capacity < needed)
+	{
+		capacity = 2 * capacity < needed ? needed : 2 * capacity;
+		capacity = capacity < RBLOCK_MAX ? capacity : RBLOCK_MAX;
+
+		grown = rrealloc_in(buffer->region, buffer->data, capacity);
+
+		if (NULL == grown && needed < capacity)
+		{
+			grown = rrealloc_in(buffer->region, buffer->data, needed);
+		}
+
+		success = NULL != grown;
+
+		if (success)
+		{
+			buffer->data = grown;
+			buffer->capacity = rsize_in(buffer->region, grown);
+		}
+	}
+
+	return success;
+}
+
+/* Format into the space after the text first. Only text longer than that
+ * space is formatted a second time, after the buffer grows. */
+
+boolean rbuf_vprintf(region_buffer * buffer, const char * format, va_list arguments)
+{
+	boolean success = false;
+	va_list retry;
+	int length;
+
+	va_copy(retry, arguments);
+	length = vsnprintf(buffer->data + buffer->length, buffer->capacity - buffer->length,
+			format, arguments);
+
+	if (0 <= length && (unsigned int)length < (unsigned int)(buffer->capacity - buffer->length))
+	{
+		success = true;
+	}
+	else if (0 <= length && rbuf_reserve(buffer, length))
+	{
+		vsnprintf(buffer->data + buffer->length, buffer->capacity - buffer->length,
+				format, retry);
+		success = true;
+	}
+
+	if (success)
+	{
+		buffer->length += length;
+	}
+	else if (NULL != buffer->data)
+	{
+		buffer->data[buffer->length] = '\0';
+	}
+
+	va_end(retry);
+
+	return success;
+}
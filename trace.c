@@ -0,0 +1,178 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "trace.h"
+
+#define TRACE_BUFFER_RECORDS 1024
+
+typedef struct TRACE_BUFFER trace_buffer;
+
+/* Each thread fills its own buffer without taking a lock and writes it
+ * out in one go when it is full. The buffers stay registered for the life
+ * of the process so rtrace_stop can drain them all. */
+
+struct TRACE_BUFFER
+{
+	trace_buffer * next;
+	unsigned int count;
+	trace_record records[TRACE_BUFFER_RECORDS];
+};
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static int trace_fd = -1;
+static unsigned long long trace_sequence = 0;
+static trace_buffer * trace_buffers = NULL;
+static __thread trace_buffer * thread_buffer = NULL;
+
+trace_buffer * register_buffer();
+void flush_buffer(trace_buffer * buffer);
+
+/* Start writing a trace to path, replacing whatever was there. */
+
+boolean rtrace_start(const char * path)
+{
+	assert(NULL != path);
+
+	boolean success = false;
+	int fd = -1;
+
+	pthread_mutex_lock(&trace_lock);
+
+	if (NULL != path && -1 == trace_fd)
+	{
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+
+	if (0 <= fd)
+	{
+		success = sizeof(TRACE_MAGIC) == write(fd, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+
+		if (success)
+		{
+			trace_sequence = 0;
+			__atomic_store_n(&trace_fd, fd, __ATOMIC_RELEASE);
+		}
+		else
+		{
+			close(fd);
+		}
+	}
+
+	pthread_mutex_unlock(&trace_lock);
+
+	return success;
+}
+
+/* Flush every thread's buffer and close the trace. Other threads should
+ * not be calling into the allocator while this runs. */
+
+void rtrace_stop()
+{
+	trace_buffer * buffer;
+
+	pthread_mutex_lock(&trace_lock);
+
+	if (-1 != trace_fd)
+	{
+		for (buffer = trace_buffers; NULL != buffer; buffer = buffer->next)
+		{
+			flush_buffer(buffer);
+		}
+
+		close(trace_fd);
+		__atomic_store_n(&trace_fd, -1, __ATOMIC_RELEASE);
+	}
+
+	pthread_mutex_unlock(&trace_lock);
+}
+
+int tracing()
+{
+	return -1 != __atomic_load_n(&trace_fd, __ATOMIC_RELAXED);
+}
+
+void trace_event(trace_op op, const void * region, unsigned short size, unsigned short offset)
+{
+	trace_buffer * buffer = thread_buffer;
+	trace_record * record;
+
+	if (NULL == buffer)
+	{
+		buffer = register_buffer();
+	}
+
+	if (NULL != buffer)
+	{
+		record = &buffer->records[buffer->count++];
+		record->sequence = __atomic_fetch_add(&trace_sequence, 1, __ATOMIC_RELAXED);
+		record->region = (unsigned long long)(size_t)region;
+		record->size = size;
+		record->offset = offset;
+		record->op = op;
+
+		if (TRACE_BUFFER_RECORDS == buffer->count)
+		{
+			pthread_mutex_lock(&trace_lock);
+			flush_buffer(buffer);
+			pthread_mutex_unlock(&trace_lock);
+		}
+	}
+}
+
+trace_buffer * register_buffer()
+{
+	trace_buffer * buffer = malloc(sizeof(trace_buffer));
+	assert(NULL != buffer);
+
+	if (NULL != buffer)
+	{
+		buffer->count = 0;
+
+		pthread_mutex_lock(&trace_lock);
+		buffer->next = trace_buffers;
+		trace_buffers = buffer;
+		pthread_mutex_unlock(&trace_lock);
+
+		thread_buffer = buffer;
+	}
+
+	return buffer;
+}
+
+/* Called with trace_lock held. If tracing stopped while the records were
+ * buffered they are dropped. */
+
+void flush_buffer(trace_buffer * buffer)
+{
+	size_t length = buffer->count * sizeof(trace_record);
+	size_t written = 0;
+	ssize_t result = 1;
+
+	while (-1 != trace_fd && written < length && 0 < result)
+	{
+		result = write(trace_fd, (char *)buffer->records + written, length - written);
+		written += 0 < result ? result : 0;
+	}
+
+	buffer->count = 0;
+}
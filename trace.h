@@ -0,0 +1,49 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+/* Trace file layout: the magic, then fixed size records. Records are
+ * written in batches from per-thread buffers, so they are not in file
+ * order across threads; sort them by sequence to replay. region is the
+ * address of the region's node, used only to tell regions apart. offset
+ * is the block's offset in its region, or TRACE_NO_BLOCK if ralloc
+ * failed. A FREE frees every block starting in its size bytes, which lets
+ * a frame region empty a frame in one record. */
+
+#define TRACE_MAGIC "RTRACE1"
+#define TRACE_NO_BLOCK 0xFFFF
+
+typedef enum TRACE_OP
+{
+	TRACE_INIT = 1,
+	TRACE_ALLOC,
+	TRACE_FREE,
+	TRACE_DESTROY
+} trace_op;
+
+typedef struct TRACE_RECORD
+{
+	unsigned long long sequence;
+	unsigned long long region;
+	unsigned short size;
+	unsigned short offset;
+	unsigned char op;
+} trace_record;
+
+int tracing();
+void trace_event(trace_op op, const void * region, unsigned short size, unsigned short offset);
+
+#endif
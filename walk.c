@@ -0,0 +1,164 @@
+//      Copyright (c) 2013, Ryan Lemieux
+//
+//      Permission to use, copy, modify, and/or distribute this software for any purpose
+//      with or without fee is hereby granted, provided that the above copyright notice
+//      and this permission notice appear in all copies.
+//
+//      THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+//      TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+//      NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+//      DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+//      IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+//      CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "globals.h"
+#include "region_list.h"
+#include "block_table.h"
+#include "pool.h"
+#include "large.h"
+#include "backing.h"
+
+#define WALK_MAX_THREADS 64
+#define WALK_MIN_BLOCKS 256
+
+/* Each thread walks one contiguous slice of the block table, or of the
+ * pool's slots. A visitor returning false stops every slice. */
+
+typedef struct WALK_SLICE
+{
+	region_node * region;
+	rblock_visitor visit;
+	void * context;
+	rsize_t first;
+	rsize_t last;
+	boolean * stopped;
+} walk_slice;
+
+boolean rforeach_block_parallel(const char * region_name, rblock_visitor visit, void * context,
+		unsigned int threads);
+void walk_slice_blocks(walk_slice * slice);
+void * walk_thread(void * slice);
+
+boolean rforeach_block(const char * region_name, rblock_visitor visit, void * context)
+{
+	return rforeach_block_parallel(region_name, visit, context, 1);
+}
+
+/* Small walks stay on the calling thread, and a slice whose thread cannot
+ * be started is walked there too. Large objects are few, so the calling
+ * thread visits them after the slices. Only shared regions are locked for
+ * the walk; any other region must not be changed while it runs. */
+
+boolean rforeach_block_parallel(const char * region_name, rblock_visitor visit, void * context,
+		unsigned int threads)
+{
+	assert(NULL != region_name);
+	assert(NULL != visit);
+	assert(0 < threads);
+
+	region_node * region = NULL;
+	walk_slice slices[WALK_MAX_THREADS];
+	pthread_t workers[WALK_MAX_THREADS];
+	boolean started[WALK_MAX_THREADS];
+	boolean stopped = false;
+	boolean success = false;
+	unsigned int block_count = 0;
+	unsigned int i;
+
+	if (NULL != region_name && NULL != visit && 0 < threads)
+	{
+		region = return_region(region_name);
+	}
+
+	if (NULL != region && (NULL != region->block_table || NULL != region->pool))
+	{
+		lock_backing(region);
+
+		block_count = NULL != region->block_table ? table_count(region->block_table)
+			: pool_object_count(region->pool);
+
+		threads = threads < WALK_MAX_THREADS ? threads : WALK_MAX_THREADS;
+		threads = threads < block_count / WALK_MIN_BLOCKS ? threads : block_count / WALK_MIN_BLOCKS;
+		threads = 0 < threads ? threads : 1;
+
+		for (i = 0; i < threads; i++)
+		{
+			slices[i].region = region;
+			slices[i].visit = visit;
+			slices[i].context = context;
+			slices[i].first = block_count * i / threads;
+			slices[i].last = block_count * (i + 1) / threads;
+			slices[i].stopped = &stopped;
+		}
+
+		for (i = 1; i < threads; i++)
+		{
+			started[i] = 0 == pthread_create(&workers[i], NULL, walk_thread, &slices[i]);
+		}
+
+		walk_slice_blocks(&slices[0]);
+
+		for (i = 1; i < threads; i++)
+		{
+			if (started[i])
+			{
+				pthread_join(workers[i], NULL);
+			}
+			else
+			{
+				walk_slice_blocks(&slices[i]);
+			}
+		}
+
+		if (NULL != region->large && !stopped)
+		{
+			stopped = !large_foreach(region->large, visit, context);
+		}
+
+		unlock_backing(region);
+
+		success = !stopped;
+	}
+
+	return success;
+}
+
+void walk_slice_blocks(walk_slice * slice)
+{
+	assert(NULL != slice);
+
+	region_node * region = slice->region;
+	rsize_t object_size;
+	rsize_t i;
+
+	for (i = slice->first; i < slice->last && !__atomic_load_n(slice->stopped, __ATOMIC_RELAXED); i++)
+	{
+		if (NULL != region->block_table && !slice->visit((char *)region->data
+					+ table_offset(region->block_table, i),
+					table_size(region->block_table, i), slice->context))
+		{
+			__atomic_store_n(slice->stopped, true, __ATOMIC_RELAXED);
+		}
+		else if (NULL != region->pool && pool_holds(region->pool, i))
+		{
+			object_size = pool_object_size(region->pool);
+
+			if (!slice->visit((char *)region->data + i * object_size, object_size, slice->context))
+			{
+				__atomic_store_n(slice->stopped, true, __ATOMIC_RELAXED);
+			}
+		}
+	}
+}
+
+void * walk_thread(void * slice)
+{
+	walk_slice_blocks(slice);
+
+	return NULL;
+}